@@ -0,0 +1,238 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "alarm.h"
+#include "launcher.h"
+#include "wmbatteries.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define MAX_RULES   16
+
+typedef struct Rule {
+  int       input;
+  int       above;          /* fires above level instead of below */
+  double    level;
+  double    hyst;
+  long      dwell;          /* msec */
+  unsigned  actions;
+  char      hook[256];
+  int       active;
+  long      since;          /* msec the condition holds since, -1 if not */
+} Rule;
+
+static const char *input_names[INPUTS] = { "total", "bat0", "bat1", "temp", "rate", "time" };
+
+static Rule   rules[MAX_RULES];
+static int    nrules;
+static Rule   staged[MAX_RULES];
+static int    nstaged;
+static double last[INPUTS];
+static int    pending;      /* rules waiting for their dwell time */
+static int    fresh = 1;    /* evaluate the next update in any case */
+
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+static int parse_actions(char *list, unsigned *actions) {
+  char *tok, *save;
+
+  *actions = 0;
+  for (tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    if (!strcmp(tok, "notify")) *actions |= ACT_NOTIFY;
+    else if (!strcmp(tok, "suspend")) *actions |= ACT_SUSPEND;
+    else if (!strcmp(tok, "hook")) *actions |= ACT_HOOK;
+    else if (!strcmp(tok, "blink")) *actions |= ACT_BLINK;
+    else if (!strcmp(tok, "light")) *actions |= ACT_LIGHT;
+    else return -1;
+  }
+  return *actions ? 0 : -1;
+}
+
+
+int alarm_parse_rule(const char *value) {
+  char  buf[512], *tok, *save, *end;
+  Rule  r;
+  int   i;
+
+  if (nstaged == MAX_RULES || strlen(value) >= sizeof(buf)) return -1;
+  strcpy(buf, value);
+  memset(&r, 0, sizeof(r));
+
+  if (!(tok = strtok_r(buf, " \t", &save))) return -1;
+  for (i = 0; i < INPUTS && strcmp(tok, input_names[i]); i++);
+  if ((r.input = i) == INPUTS) return -1;
+
+  if (!(tok = strtok_r(NULL, " \t", &save)) || tok[1] || (*tok != '<' && *tok != '>')) return -1;
+  r.above = *tok == '>';
+  if (!(tok = strtok_r(NULL, " \t", &save))) return -1;
+  r.level = strtod(tok, &end);
+  if (*end || end == tok) return -1;
+
+  while ((tok = strtok_r(NULL, " \t", &save))) {
+    if (!strcmp(tok, "hyst") || !strcmp(tok, "dwell")) {
+      char *arg = strtok_r(NULL, " \t", &save);
+      double v;
+
+      if (!arg || (v = strtod(arg, &end)) < 0 || *end || end == arg) return -1;
+      if (tok[0] == 'h') r.hyst = v;
+      else r.dwell = v * 1000;
+      continue;
+    }
+    if (parse_actions(tok, &r.actions) < 0) return -1;
+    break;
+  }
+  if (!r.actions) return -1;
+  if (r.actions & ACT_HOOK) {
+    /* the rest of the line, as given */
+    if (!save || !*(save += strspn(save, " \t"))) return -1;
+    snprintf(r.hook, sizeof(r.hook), "%s", save);
+  } else if (save && *(save + strspn(save, " \t"))) {
+    return -1;
+  }
+  staged[nstaged++] = r;
+  /* whether anything changed is up to alarm_commit() */
+  return 0;
+}
+
+
+void alarm_begin(void) {
+  nstaged = 0;
+}
+
+
+static void add_default(int input, int above, double level, unsigned actions) {
+  Rule *r = &staged[nstaged++];
+
+  memset(r, 0, sizeof(*r));
+  r->input = input;
+  r->above = above;
+  r->level = level;
+  r->hyst = 1;
+  r->actions = actions;
+}
+
+
+static int same_rule(const Rule *a, const Rule *b) {
+  return a->input == b->input && a->above == b->above && a->level == b->level &&
+         a->hyst == b->hyst && a->dwell == b->dwell && a->actions == b->actions &&
+         !strcmp(a->hook, b->hook);
+}
+
+
+int alarm_commit(int level, int critical, int temp, int blink) {
+  int i;
+
+  if (!nstaged) {
+    /* what wmbatteries always did, with a little hysteresis against flapping */
+    add_default(IN_TOTAL, 0, level, ACT_NOTIFY | (blink ? ACT_BLINK : ACT_LIGHT));
+    add_default(IN_TOTAL, 0, critical, ACT_SUSPEND);
+    add_default(IN_TEMP, 1, temp, ACT_NOTIFY | (blink ? ACT_BLINK : ACT_LIGHT));
+    add_default(IN_TEMP, 1, temp + 5, ACT_SUSPEND);
+  }
+  if (nstaged == nrules) {
+    for (i = 0; i < nrules && same_rule(&rules[i], &staged[i]); i++);
+    if (i == nrules) return 0;
+  }
+  for (i = 0; i < nstaged; i++) {
+    rules[i] = staged[i];
+    rules[i].active = 0;
+    rules[i].since = -1;
+  }
+  nrules = nstaged;
+  fresh = 1;
+  DPRINTF("D: %d alarm rules\n", nrules)
+  return 1;
+}
+
+
+static void fire(const Rule *r, const char *notify, const char *suspend) {
+  if (r->actions & ACT_NOTIFY) launcher_run(notify);
+  if (r->actions & ACT_SUSPEND) launcher_run(suspend);
+  if (r->actions & ACT_HOOK) launcher_run(r->hook);
+}
+
+
+unsigned alarm_update(const double *in, const char *notify, const char *suspend) {
+  static unsigned lights;
+  Rule    *r;
+  double  v;
+  long    now;
+  int     i, changed = fresh;
+
+  for (i = 0; i < INPUTS; i++) {
+    /* NAN != NAN, so compare unknown values by hand */
+    if (in[i] != last[i] && !(isnan(in[i]) && isnan(last[i]))) changed = 1;
+    last[i] = in[i];
+  }
+  if (!changed && !pending) return lights;
+  fresh = 0;
+  pending = 0;
+  lights = 0;
+  now = now_ms();
+
+  for (r = rules; r < rules + nrules; r++) {
+    v = in[r->input];
+    if (isnan(v)) {
+      r->since = -1;
+    } else if (!r->active) {
+      if (r->above ? v > r->level : v < r->level) {
+        if (r->since < 0) r->since = now;
+        if (now - r->since >= r->dwell) {
+          r->active = 1;
+          DPRINTF("D: alarm rule %s %c %g fired at %g\n", input_names[r->input], r->above ? '>' : '<', r->level, v)
+          fire(r, notify, suspend);
+        } else {
+          pending = 1;
+        }
+      } else {
+        r->since = -1;
+      }
+    } else if (r->above ? v <= r->level - r->hyst : v >= r->level + r->hyst) {
+      r->active = 0;
+      r->since = -1;
+      DPRINTF("D: alarm rule %s %c %g cleared at %g\n", input_names[r->input], r->above ? '>' : '<', r->level, v)
+    }
+    if (r->active) lights |= r->actions & (ACT_BLINK | ACT_LIGHT);
+  }
+  return lights;
+}
+
+
+int alarm_uses(int input) {
+  int i;
+
+  for (i = 0; i < nrules; i++)
+    if (rules[i].input == input) return 1;
+  return 0;
+}
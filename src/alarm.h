@@ -0,0 +1,55 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef ALARM_H
+#define ALARM_H
+
+/*
+ * Alarm rules, one per 'rule' line of the config file:
+ *
+ *   rule = <input> <|> <level> [hyst <n>] [dwell <sec>] <action>[,<action>] [<command>]
+ *
+ * Inputs are total, bat0, bat1 (percent), temp (deg C), rate (W) and time
+ * (minutes left). A rule fires once its condition held for 'dwell'
+ * seconds and clears when the input is back beyond level +/- hyst.
+ * Actions: notify and suspend run the notify/suspend commands, hook runs
+ * the command at the end of the line, blink and light drive the
+ * back-light while the rule is active. Without rule lines the alarm,
+ * critical and alarm_blink options give the classic rules.
+ */
+enum { IN_TOTAL, IN_BAT0, IN_BAT1, IN_TEMP, IN_RATE, IN_TIME, INPUTS };
+
+#define ACT_NOTIFY    0x01
+#define ACT_SUSPEND   0x02
+#define ACT_HOOK      0x04
+#define ACT_BLINK     0x08
+#define ACT_LIGHT     0x10
+
+/* OPT_CUSTOM parser for the rule lines, collected until alarm_commit() */
+int  alarm_parse_rule(const char *value);
+void alarm_begin(void);
+/* takes over the collected rules, returns 1 if they differ from before */
+int  alarm_commit(int level, int critical, int temp, int blink);
+/*
+ * Feeds new input values (NAN if unknown), runs the commands of rules
+ * that fire and returns the ACT_BLINK/ACT_LIGHT bits of the active ones.
+ * Nothing is evaluated when no input changed and no dwell time runs.
+ */
+unsigned alarm_update(const double *in, const char *notify, const char *suspend);
+/* whether a rule looks at the input, the sources of others need no reads */
+int  alarm_uses(int input);
+
+#endif	/* ifndef ALARM_H */
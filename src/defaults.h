@@ -6,6 +6,15 @@
 #define CAPS_NUM_UPD_SPD	200
 /* Defaults */
 #define UPDATE_INTERVAL	5000
+#define IDLE_INTERVAL	120000	/* sampling in deep idle, 0 to disable it */
+#define THERMAL_INTERVAL	10000	/* msec between temperature reads */
+#define CAPACITY_INTERVAL	3600000	/* msec between full capacity reads */
+#define SAMPLE_TIMEOUT	1000	/* msec before a hanging source is stale */
+#define LATENCY_LOG	100000	/* usec, log sysfs reads slower than this */
+#define METRICS_INTERVAL	15000	/* min msec between two metrics file writes */
+#define PROCS_SCAN	0		/* /proc entries read per sample, 0 = no process view */
+#define CPU_BUDGET	1000	/* usec of CPU per second (0.1%), 0 = no limit */
+#define WAKEUP_BUDGET	600		/* wakeups per minute, 0 = no limit */
 #define ANIMATION_SPEED	500
 #define RATE_HISTORY	10
 #define STATMODE		TEMP		/* [RATE|TEMP] */
@@ -14,8 +23,14 @@
 #define ALARM_BLINK 	1
 #define ALARM_LEVEL 	15
 #define ALARM_TEMP	 	75
+#define CRITICAL_LEVEL	5		/* percent, runs the suspend command */
+#define BLINK_SPEED		1000	/* msec per back-light blink in alarm */
+#define THERMAL_POLICY	""		/* [max|avg|file|<sensor name>], "" is file
+					   if temperature is set, else max */
+#define CMD_INTERVAL	60000	/* min msec between two runs of a command */
+#define DIRECT_EXEC 	1		/* skip /bin/sh for plain commands */
 
-#define WINDOWED_BG		". c #AEAAAE"
+#define WINDOWED_BG		"rgb:ae/aa/ae"
 #define WINDOWED_SIZE_W	64
 #define WINDOWED_SIZE_H	64
 
@@ -25,6 +25,9 @@
 
 #include "defaults.h"
 #include "dockapp.h"
+#ifdef HAVE_XLIB_XCB
+# include <X11/Xlib-xcb.h>
+#endif
 
 /* global */
 Display	*display = NULL;
@@ -40,6 +43,47 @@ static Atom	delete_win;
 static int	width, height;
 static int	offset_w, offset_h;
 
+/* one entry per opened display, the globals above mirror the current one */
+typedef struct {
+    Display	*display;
+    Window	window;
+    Window	icon_window;
+    GC		gc;
+    int		depth;
+    Atom	delete_win;
+    Bool	lost;		/* the connection broke, close at the next wait */
+} DockappContext;
+static DockappContext	contexts[DOCKAPP_MAX_DISPLAYS];
+static int	ncontexts = 0;
+static int	nopen = 0;
+static int	current = 0;
+
+#define MAX_WATCHES 32
+static struct {
+    int			fd;
+    dockapp_fd_handler	handler;
+    void		*data;
+} watches[MAX_WATCHES];
+static int	nwatches = 0;
+static Bool	wakeup = False;
+
+static Bool	parse_color(const char *name, XColor *color);
+static void	alloc_colors(XColor *colors, Bool *ok, int n);
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+/*
+ * Called by Xlib once a connection is broken, instead of exit(). The display
+ * can't be closed from within Xlib, that is left to the next wait; until
+ * then Xlib turns requests on it into no-ops.
+ */
+static void
+io_error_exit(Display *dpy, void *data)
+{
+    ((DockappContext *)data)->lost = True;
+}
+#endif
+
+
 void
 dockapp_open_window(char *display_specified, char *appname,
 		    unsigned w, unsigned h, int argc, char **argv)
@@ -51,6 +95,11 @@ dockapp_open_window(char *display_specified, char *appname,
     Window	    root;
     int		    ww, wh;
 
+    if (ncontexts >= DOCKAPP_MAX_DISPLAYS) {
+	fprintf(stderr, "%s: too many displays\n", argv[0]);
+	exit(1);
+    }
+
     /* Open Connection to X Server */
     display = XOpenDisplay(display_specified);
     if (!display) {
@@ -140,6 +189,74 @@ dockapp_open_window(char *display_specified, char *appname,
 
     XFree(title.value);
     XFlush(display);
+
+    current = ncontexts++;
+    contexts[current].display = display;
+    contexts[current].window = window;
+    contexts[current].icon_window = icon_window;
+    contexts[current].gc = gc;
+    contexts[current].depth = depth;
+    contexts[current].delete_win = delete_win;
+    contexts[current].lost = False;
+    nopen++;
+#ifdef HAVE_XSETIOERROREXITHANDLER
+    XSetIOErrorExitHandler(display, io_error_exit, &contexts[current]);
+#endif
+}
+
+
+int
+dockapp_display_count(void)
+{
+    return ncontexts;
+}
+
+
+int
+dockapp_current(void)
+{
+    return current;
+}
+
+
+/* returns False for a display that has been closed */
+Bool
+dockapp_select(int n)
+{
+    if (contexts[n].display == NULL)
+	return False;
+    current = n;
+    display = contexts[n].display;
+    window = contexts[n].window;
+    icon_window = contexts[n].icon_window;
+    gc = contexts[n].gc;
+    depth = contexts[n].depth;
+    delete_win = contexts[n].delete_win;
+    return True;
+}
+
+
+/*
+ * Closes the window of one display, the others carry on. The process ends
+ * with the last one.
+ */
+static void
+close_context(int n)
+{
+    DockappContext *c = &contexts[n];
+    int i;
+
+    if (!c->lost)
+	XDestroyWindow(c->display, c->icon_window);
+    XCloseDisplay(c->display);
+    c->display = NULL;
+    if (--nopen == 0)
+	exit(c->lost ? 1 : 0);
+    if (n == current) {
+	for (i = 0; contexts[i].display == NULL; i++)
+	    ;
+	dockapp_select(i);
+    }
 }
 
 
@@ -207,22 +324,97 @@ dockapp_show(void)
 }
 
 
+/*
+ * Creates a pixmap from pre-parsed image data: the palette is resolved once
+ * and the pixels are sent with a single XPutImage. Symbolic colours found in
+ * colorSymbol replace the palette entry.
+ */
 Bool
-dockapp_xpm2pixmap(char **data, Pixmap *pixmap, Pixmap *mask,
-		   XpmColorSymbol * colorSymbol, unsigned int nsymbols)
+dockapp_image2pixmap(const DockappImage *img, Pixmap *pixmap, Pixmap *mask,
+		     DockappColorSymbol *colorSymbol, unsigned int nsymbols)
 {
-    XpmAttributes xpmAttr;
-    xpmAttr.valuemask = XpmCloseness;
-    xpmAttr.closeness = 40000;
+    unsigned long   pixels[256];
+    Bool	    transparent[256];
+    XColor	    colors[256];
+    Bool	    ok[256];
+    int		    index[256], n;
+    Bool	    has_mask = False;
+    XImage	    *image;
+    char	    *bits;
+    int		    i, j, x, y, bpl;
+    const unsigned char *src = img->pixels;
+
+    if (img->ncolors > 256)
+	return False;
 
-    if (nsymbols) {
-	xpmAttr.colorsymbols = colorSymbol;
-	xpmAttr.numsymbols = nsymbols;
-	xpmAttr.valuemask |= XpmColorSymbols;
+    /* resolve the palette, the colours to allocate in one batch */
+    for (i = n = 0; i < img->ncolors; i++) {
+	transparent[i] = !strcasecmp(img->colors[i].color, "None");
+	if (transparent[i]) {
+	    has_mask = True;
+	    pixels[i] = dockapp_iswindowed ? dockapp_getcolor(WINDOWED_BG) : 0;
+	    continue;
+	}
+	for (j = 0; j < nsymbols; j++) {
+	    if (img->colors[i].symbol &&
+		!strcmp(img->colors[i].symbol, colorSymbol[j].name))
+		break;
+	}
+	if (j < nsymbols) {
+	    pixels[i] = colorSymbol[j].pixel;
+	    continue;
+	}
+	if (!parse_color(img->colors[i].color, &colors[n]))
+	    fprintf(stderr, "can't parse color %s\n", img->colors[i].color),
+	    exit(1);
+	index[n++] = i;
     }
+    alloc_colors(colors, ok, n);
+    for (j = 0; j < n; j++) {
+	if (!ok[j])
+	    fprintf(stderr, "can't allocate color %s. Using black\n",
+		    img->colors[index[j]].color);
+	pixels[index[j]] = ok[j] ? colors[j].pixel
+				 : BlackPixel(display, DefaultScreen(display));
+    }
+
+    image = XCreateImage(display, DefaultVisual(display, DefaultScreen(display)),
+			 depth, ZPixmap, 0, NULL, img->width, img->height,
+			 32, 0);
+    if (image == NULL)
+	return False;
+    if ((image->data = malloc(image->bytes_per_line * img->height)) == NULL) {
+	XDestroyImage(image);
+	return False;
+    }
+    for (y = 0; y < img->height; y++)
+	for (x = 0; x < img->width; x++)
+	    XPutPixel(image, x, y, pixels[*src++]);
 
-    if (XpmCreatePixmapFromData(display, icon_window, data, pixmap, mask, &xpmAttr) != 0)
+    *pixmap = XCreatePixmap(display, icon_window, img->width, img->height,
+			    depth);
+    XPutImage(display, *pixmap, gc, image, 0, 0, 0, 0, img->width,
+	      img->height);
+    XDestroyImage(image);
+
+    if (mask == NULL)
+	return True;
+    *mask = None;
+    if (!has_mask || dockapp_iswindowed)
+	return True;
+
+    /* shape mask in XBM layout: LSB first, rows padded to bytes */
+    bpl = (img->width + 7) / 8;
+    if ((bits = calloc(bpl * img->height, 1)) == NULL)
 	return False;
+    src = img->pixels;
+    for (y = 0; y < img->height; y++)
+	for (x = 0; x < img->width; x++)
+	    if (!transparent[*src++])
+		bits[y * bpl + x / 8] |= 1 << (x % 8);
+    *mask = XCreateBitmapFromData(display, icon_window, bits, img->width,
+				  img->height);
+    free(bits);
 
     return True;
 }
@@ -267,62 +459,368 @@ dockapp_copy2window (Pixmap src)
 }
 
 
+Bool
+dockapp_watch_fd(int fd, dockapp_fd_handler handler, void *data)
+{
+    if (nwatches >= MAX_WATCHES)
+	return False;
+    watches[nwatches].fd = fd;
+    watches[nwatches].handler = handler;
+    watches[nwatches].data = data;
+    nwatches++;
+    return True;
+}
+
+
+/* called from a handler: end the current wait instead of sleeping on */
+void
+dockapp_wakeup(void)
+{
+    wakeup = True;
+}
+
+
+void
+dockapp_unwatch_fd(int fd)
+{
+    int i;
+
+    /* entries are only marked here, dispatch_watches() compacts the list */
+    for (i = 0; i < nwatches; i++)
+	if (watches[i].fd == fd)
+	    watches[i].fd = -1;
+}
+
+
+static int
+fill_watches(fd_set *rset, int maxfd)
+{
+    int i;
+
+    for (i = 0; i < nwatches; i++) {
+	if (watches[i].fd < 0)
+	    continue;
+	FD_SET(watches[i].fd, rset);
+	if (watches[i].fd > maxfd)
+	    maxfd = watches[i].fd;
+    }
+    return maxfd;
+}
+
+
+static void
+dispatch_watches(fd_set *rset)
+{
+    int i, j, n = nwatches;
+
+    /* handlers may add watches; those are not part of this select round */
+    for (i = 0; i < n; i++)
+	if (watches[i].fd >= 0 && FD_ISSET(watches[i].fd, rset))
+	    watches[i].handler(watches[i].fd, watches[i].data);
+
+    for (i = j = 0; i < nwatches; i++)
+	if (watches[i].fd >= 0)
+	    watches[j++] = watches[i];
+    nwatches = j;
+}
+
+
+/*
+ * Number of events queued on display n. Xlib notices a broken connection
+ * here rather than in XNextEvent(), such a display is closed and counts as
+ * having none.
+ */
+static int
+pending(int n)
+{
+    int queued = contexts[n].lost ? 0 : XPending(contexts[n].display);
+
+    if (contexts[n].lost) {
+	close_context(n);
+	return 0;
+    }
+    return queued;
+}
+
+
+/* False if the event closed the window */
+static Bool
+next_event(XEvent *event)
+{
+    XNextEvent(display, event);
+    if (event->type == ClientMessage) {
+	if (event->xclient.data.l[0] == delete_win) {
+	    close_context(current);
+	    return False;
+	}
+    }
+    if (dockapp_iswindowed) {
+	    event->xbutton.x -= offset_w;
+	    event->xbutton.y -= offset_h;
+    }
+    return True;
+}
+
+
+/*
+ * Waits on every open display and watched fd. When an event is returned,
+ * the display it came from has been made the current one. A window closed
+ * by the window manager ends the wait like a timeout.
+ */
 Bool
 dockapp_nextevent_or_timeout(XEvent *event, unsigned long miliseconds)
 {
-    struct timeval timeout;
+    struct timeval timeout, start, now;
+    long usec, left;
     fd_set rset;
+    int i, xfd, maxfd;
+
+    for (i = 0; i < ncontexts; i++) {
+	if (contexts[i].display == NULL)
+	    continue;
+	if (!contexts[i].lost)
+	    XSync(contexts[i].display, False);
+	if (pending(i)) {
+	    dockapp_select(i);
+	    return next_event(event);
+	}
+    }
 
-    XSync(display, False);
-    if (XPending(display)) {
-	XNextEvent(display, event);
-	return True;
+    usec = miliseconds * 1000;
+    gettimeofday(&start, NULL);
+
+    for (;;) {
+	timeout.tv_sec = usec / 1000000;
+	timeout.tv_usec = usec % 1000000;
+
+	FD_ZERO(&rset);
+	maxfd = -1;
+	for (i = 0; i < ncontexts; i++) {
+	    if (contexts[i].display == NULL)
+		continue;
+	    xfd = ConnectionNumber(contexts[i].display);
+	    FD_SET(xfd, &rset);
+	    if (xfd > maxfd)
+		maxfd = xfd;
+	}
+	if (select(fill_watches(&rset, maxfd) + 1, &rset, NULL, NULL,
+		   &timeout) <= 0)
+	    return False;
+	dispatch_watches(&rset);
+	for (i = 0; i < ncontexts; i++) {
+	    if (contexts[i].display
+		&& FD_ISSET(ConnectionNumber(contexts[i].display), &rset)
+		&& pending(i)) {
+		dockapp_select(i);
+		return next_event(event);
+	    }
+	}
+	if (wakeup) {
+	    wakeup = False;
+	    return False;
+	}
+
+	/* only a watched fd woke us, sleep for the rest of the slice */
+	gettimeofday(&now, NULL);
+	left = miliseconds * 1000 - ((now.tv_sec - start.tv_sec) * 1000000
+				    + (now.tv_usec - start.tv_usec));
+	if (left <= 0)
+	    return False;
+	usec = left;
     }
+}
 
-#if CAPS_NUM_UPD_SPD > 0
-    timeout.tv_sec = 0;
-    if (miliseconds<CAPS_NUM_UPD_SPD)
-	timeout.tv_usec = miliseconds * 1000;
-    else
-	timeout.tv_usec = CAPS_NUM_UPD_SPD * 1000;
-#else
-    timeout.tv_sec = miliseconds / 1000;
-    timeout.tv_usec = (miliseconds % 1000) * 1000;
-#endif
 
-    FD_ZERO(&rset);
-    FD_SET(ConnectionNumber(display), &rset);
-    if (select(ConnectionNumber(display)+1, &rset, NULL, NULL, &timeout) > 0) {
-	XNextEvent(display, event);
-	if (event->type == ClientMessage) {
-	    if (event->xclient.data.l[0] == delete_win) {
-		XDestroyWindow(display,event->xclient.window);
-		XCloseDisplay(display);
-		exit(0);
-	    }
+/*
+ * Numeric colour specs ("#rgb" forms and "rgb:r/g/b") are parsed locally,
+ * anything else is looked up by the server.
+ */
+static Bool
+parse_color(const char *name, XColor *color)
+{
+    unsigned short  *comp[3];
+    const char	    *p;
+    char	    *end;
+    unsigned long   v;
+    int		    i, n, len;
+
+    comp[0] = &color->red;
+    comp[1] = &color->green;
+    comp[2] = &color->blue;
+    color->flags = DoRed | DoGreen | DoBlue;
+
+    if (name[0] == '#') {
+	len = strlen(name + 1);
+	if (len % 3 || len == 0 || len > 12
+	    || strspn(name + 1, "0123456789abcdefABCDEF") != len)
+	    goto server;
+	n = len / 3;
+	for (i = 0; i < 3; i++) {
+	    v = 0;
+	    for (p = name + 1 + i * n; p < name + 1 + (i + 1) * n; p++)
+		v = (v << 4) | (*p <= '9' ? *p - '0' : (*p | 0x20) - 'a' + 10);
+	    *comp[i] = v << (16 - 4 * n);
 	}
-	if (dockapp_iswindowed) {
-		event->xbutton.x -= offset_w;
-		event->xbutton.y -= offset_h;
+	return True;
+    }
+
+    if (!strncasecmp(name, "rgb:", 4)) {
+	p = name + 4;
+	for (i = 0; i < 3; i++) {
+	    v = strtoul(p, &end, 16);
+	    n = end - p;
+	    if (n < 1 || n > 4 || (i < 2 && *end != '/') || (i == 2 && *end))
+		goto server;
+	    /* scale h, hh, hhh to 16 bits the way XParseColor does */
+	    *comp[i] = v * 0xffff / ((1UL << (4 * n)) - 1);
+	    p = end + 1;
 	}
 	return True;
     }
 
+server:
+    return XParseColor(display,
+		       DefaultColormap(display, DefaultScreen(display)),
+		       name, color);
+}
+
+
+static unsigned long
+scale_to_mask(unsigned short value, unsigned long mask)
+{
+    int shift = 0, bits = 0;
+
+    while (mask && !(mask & 1)) {
+	mask >>= 1;
+	shift++;
+    }
+    while (mask & 1) {
+	mask >>= 1;
+	bits++;
+    }
+    return ((unsigned long)value >> (16 - bits)) << shift;
+}
+
+
+/* allocated colours, keyed by the requested values */
+#define COLOR_CACHE 32
+static struct {
+    Display	    *display;
+    unsigned short  red, green, blue;
+    unsigned long   pixel;
+} color_cache[COLOR_CACHE];
+static int ncached = 0;
+
+static Bool
+cached_color(XColor *color)
+{
+    int i;
+
+    for (i = 0; i < ncached; i++) {
+	if (color_cache[i].display == display
+	    && color_cache[i].red == color->red
+	    && color_cache[i].green == color->green
+	    && color_cache[i].blue == color->blue) {
+	    color->pixel = color_cache[i].pixel;
+	    return True;
+	}
+    }
     return False;
 }
 
+static void
+cache_color(const XColor *requested, unsigned long pixel)
+{
+    int i = ncached < COLOR_CACHE ? ncached++ : COLOR_CACHE - 1;
+
+    color_cache[i].display = display;
+    color_cache[i].red = requested->red;
+    color_cache[i].green = requested->green;
+    color_cache[i].blue = requested->blue;
+    color_cache[i].pixel = pixel;
+}
+
+
+/*
+ * Resolves up to 256 colours, ok[i] tells which ones worked. On TrueColor
+ * and DirectColor visuals the pixel values follow from the visual masks, so
+ * no request is sent. Other visuals need an AllocColor request per colour
+ * not cached yet; through XCB they are all sent before the first reply is
+ * read, which makes a palette one round trip rather than one per colour.
+ */
+static void
+alloc_colors(XColor *colors, Bool *ok, int n)
+{
+    Visual	*visual = DefaultVisual(display, DefaultScreen(display));
+    Colormap	cmap = DefaultColormap(display, DefaultScreen(display));
+    int		i;
+#ifdef HAVE_XLIB_XCB
+    xcb_connection_t	    *conn = XGetXCBConnection(display);
+    xcb_alloc_color_cookie_t cookies[256];
+    xcb_alloc_color_reply_t *reply;
+#else
+    XColor	requested;
+#endif
+
+    if (visual->class == TrueColor || visual->class == DirectColor) {
+	for (i = 0; i < n; i++) {
+	    colors[i].pixel = scale_to_mask(colors[i].red, visual->red_mask)
+			    | scale_to_mask(colors[i].green, visual->green_mask)
+			    | scale_to_mask(colors[i].blue, visual->blue_mask);
+	    ok[i] = True;
+	}
+	return;
+    }
+
+    for (i = 0; i < n; i++)
+	ok[i] = cached_color(&colors[i]);
+
+#ifdef HAVE_XLIB_XCB
+    for (i = 0; i < n; i++)
+	if (!ok[i])
+	    cookies[i] = xcb_alloc_color(conn, cmap, colors[i].red,
+					 colors[i].green, colors[i].blue);
+    for (i = 0; i < n; i++) {
+	if (ok[i])
+	    continue;
+	if ((reply = xcb_alloc_color_reply(conn, cookies[i], NULL)) == NULL)
+	    continue;
+	colors[i].pixel = reply->pixel;
+	cache_color(&colors[i], reply->pixel);
+	free(reply);
+	ok[i] = True;
+    }
+#else
+    for (i = 0; i < n; i++) {
+	if (ok[i])
+	    continue;
+	requested = colors[i];
+	if ((ok[i] = XAllocColor(display, cmap, &colors[i])))
+	    cache_color(&requested, colors[i].pixel);
+    }
+#endif
+}
+
+
+static Bool
+alloc_color(XColor *color)
+{
+    Bool ok;
+
+    alloc_colors(color, &ok, 1);
+    return ok;
+}
+
 
 unsigned long
 dockapp_getcolor(char *color_name)
 {
     XColor color;
 
-    if (!XParseColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     color_name, &color))
+    if (!parse_color(color_name, &color))
 	fprintf(stderr, "can't parse color %s\n", color_name), exit(1);
 
-    if (!XAllocColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     &color)) {
+    if (!alloc_color(&color)) {
 	fprintf(stderr, "can't allocate color %s. Using black\n", color_name);
 	return BlackPixel(display, DefaultScreen(display));
     }
@@ -345,18 +843,16 @@ dockapp_blendedcolor(char *color_name, int r, int g, int b, float fac)
     g *= 255;
     b *= 255;
 
-    if (!XParseColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     color_name, &color))
+    if (!parse_color(color_name, &color))
 	fprintf(stderr, "can't parse color %s\n", color_name), exit(1);
 
-    if (!XAllocColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     &color)) {
-	fprintf(stderr, "can't allocate color %s. Using black\n", color_name);
-	return BlackPixel(display, DefaultScreen(display));
-    }
-
-    if (DefaultDepth(display, DefaultScreen(display)) < 16)
+    if (DefaultDepth(display, DefaultScreen(display)) < 16) {
+	if (!alloc_color(&color)) {
+	    fprintf(stderr, "can't allocate color %s. Using black\n", color_name);
+	    return BlackPixel(display, DefaultScreen(display));
+	}
 	return color.pixel;
+    }
 
     /* red */
     if (color.red + r > 0xffff) {
@@ -387,8 +883,7 @@ dockapp_blendedcolor(char *color_name, int r, int g, int b, float fac)
 
     color.flags = DoRed | DoGreen | DoBlue;
 
-    if (!XAllocColor(display, DefaultColormap(display, DefaultScreen(display)),
-		     &color)) {
+    if (!alloc_color(&color)) {
 	fprintf(stderr, "can't allocate color %s. Using black\n", color_name);
 	return BlackPixel(display, DefaultScreen(display));
     }
@@ -28,7 +28,6 @@
 #endif
 
 #include <X11/Xlib.h>
-#include <X11/xpm.h>
 #include <X11/extensions/shape.h>
 
 #include <stdio.h>
@@ -73,6 +72,8 @@
 /* We are in trouble. */
 #endif
 
+#define DOCKAPP_MAX_DISPLAYS 8
+
 extern GC	gc;
 extern Display *display;
 extern Bool dockapp_iswindowed;
@@ -81,12 +82,34 @@ extern Bool dockapp_isbrokenwm;
 
 void dockapp_open_window(char *display_specified, char *appname,
 			 unsigned w, unsigned h, int argc, char **argv);
+int  dockapp_display_count(void);
+int  dockapp_current(void);
+Bool dockapp_select(int n);
 void dockapp_set_eventmask(long mask);
 void dockapp_set_background(Pixmap pixmap);
 void dockapp_show(void);
-Bool dockapp_xpm2pixmap(char **data, Pixmap * pixmap, Pixmap * mask,
-			XpmColorSymbol * colorSymbol,
-			unsigned int nsymbols);
+
+/* palette indexed image, generated at build time by xpm2c.awk */
+typedef struct {
+    const char	*color;		/* colour spec, "None" if transparent */
+    const char	*symbol;	/* symbolic name or NULL */
+} DockappColor;
+
+typedef struct {
+    int			width, height, ncolors;
+    const DockappColor	*colors;
+    const unsigned char	*pixels;	/* width * height palette indices */
+} DockappImage;
+
+/* replaces the palette entries with a matching symbolic name */
+typedef struct {
+    const char		*name;
+    unsigned long	pixel;
+} DockappColorSymbol;
+
+Bool dockapp_image2pixmap(const DockappImage *img, Pixmap *pixmap,
+			  Pixmap *mask, DockappColorSymbol *colorSymbol,
+			  unsigned int nsymbols);
 Pixmap dockapp_XCreatePixmap(int w, int h);
 void dockapp_setshape(Pixmap mask, int x_ofs, int y_ofs);
 /*
@@ -98,5 +121,11 @@ void dockapp_copyarea(Pixmap src, Pixmap dist, int x_src, int y_src,
 
 void dockapp_copy2window(Pixmap src);
 Bool dockapp_nextevent_or_timeout(XEvent * event, unsigned long miliseconds);
+
+/* extra file descriptors serviced while waiting for X events */
+typedef void (*dockapp_fd_handler)(int fd, void *data);
+Bool dockapp_watch_fd(int fd, dockapp_fd_handler handler, void *data);
+void dockapp_unwatch_fd(int fd);
+void dockapp_wakeup(void);
 unsigned long dockapp_getcolor(char *color);
 unsigned long dockapp_blendedcolor(char *color, int r, int g, int b, float fac);
@@ -0,0 +1,270 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+#include "energy.h"
+#include "wmbatteries.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#define ENERGY_CHECK  500000    /* uWh the counter moves between two checks */
+#define ENERGY_GAP    300000    /* msec, samples further apart are not integrated */
+#define ENERGY_SAVE   600000    /* min msec between two writes of the file */
+#define BOOT_ID       "/proc/sys/kernel/random/boot_id"
+
+typedef struct Battery {
+  long      at;                 /* msec of the last sample, 0 if none */
+  int       status;
+  long      power;
+  long      energy;
+  double    integral;           /* since the last check */
+  long      counter;            /* how far the energy counter moved meanwhile */
+} Battery;
+
+static const char *period_names[ENERGY_PERIODS] = { "boot", "day", "unplugged" };
+
+static Battery  bats[2];
+static int      last_nbat = -1;
+static int      last_ac = -1;
+static int      unit_amps = -1;               /* the totals are uAh, -1 if none yet */
+static double   totals[ENERGY_PERIODS][2];   /* used, charged */
+static char     boot_id[40];
+static long     today;                        /* yyyymmdd */
+static char     path[256];
+static char     tmp_path[sizeof(path) + 4];
+static long     saved_at;
+static int      dirty;
+static long     checks, corrected, gaps;
+static double   last_ratio = -1;              /* integral/counter at the last check */
+
+
+static long boot_ms(void) {
+  struct timespec ts;
+
+#ifdef CLOCK_BOOTTIME
+  /* keeps running through a suspend, which makes it a gap */
+  if (clock_gettime(CLOCK_BOOTTIME, &ts) == 0) return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+#endif
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+static long local_day(void) {
+  time_t    t = time(NULL);
+  struct tm tm;
+
+  localtime_r(&t, &tm);
+  return (tm.tm_year + 1900) * 10000L + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+}
+
+
+static void read_boot_id(char *id, int len) {
+  FILE *f;
+
+  id[0] = '\0';
+  if ((f = fopen(BOOT_ID, "r"))) {
+    if (fgets(id, len, f)) id[strcspn(id, "\n")] = '\0';
+    fclose(f);
+  }
+}
+
+
+static void add(int charged, double uwh) {
+  int p;
+
+  for (p = 0; p < ENERGY_PERIODS; p++) totals[p][charged] += uwh;
+  dirty = 1;
+}
+
+
+static void check(Battery *b, int charged) {
+  checks++;
+  last_ratio = b->integral / b->counter;
+  /* a missing or broken power reading, the counter knows better */
+  if (last_ratio < 0.75 || last_ratio > 1.33) {
+    DPRINTF("D: power integrates to %.0f%% of the energy counter, using the counter\n", last_ratio * 100)
+    add(charged, b->counter - b->integral);
+    corrected++;
+  }
+  b->integral = 0;
+  b->counter = 0;
+}
+
+
+static void account(Battery *b, int status, long power, long energy, long now) {
+  int   charged = status == CHARGING;
+  long  moved = 0, dt = now - b->at;
+  double trap;
+
+  if (b->at && status == b->status && (status == CHARGING || status == DISCHARGING)) {
+    if (b->energy > 0 && energy > 0) moved = charged ? energy - b->energy : b->energy - energy;
+    /* the counter going the wrong way is a recalibration */
+    if (moved < 0) moved = 0;
+    if (dt > ENERGY_GAP) {
+      gaps++;
+      add(charged, moved);
+      b->integral = 0;
+      b->counter = 0;
+    } else {
+      trap = (b->power + power) / 2.0 * dt / 3600000;
+      add(charged, trap);
+      b->integral += trap;
+      b->counter += moved;
+      if (b->counter >= ENERGY_CHECK) check(b, charged);
+    }
+  } else {
+    b->integral = 0;
+    b->counter = 0;
+  }
+  b->at = now;
+  b->status = status;
+  b->power = power;
+  b->energy = energy;
+}
+
+
+static void save(long now) {
+  FILE  *f;
+  int   p, ok;
+
+  saved_at = now;
+  dirty = 0;
+  if (!(f = fopen(tmp_path, "w"))) {
+    fprintf(stderr, "open(%s): %s\n", tmp_path, strerror(errno));
+    path[0] = '\0';
+    return;
+  }
+  fprintf(f, "boot_id %s\ndate %ld\nac %d\nunit %s\n", boot_id, today, last_ac,
+          unit_amps == 1 ? "Ah" : "Wh");
+  for (p = 0; p < ENERGY_PERIODS; p++)
+    fprintf(f, "%s %.0f %.0f\n", period_names[p], totals[p][0], totals[p][1]);
+  ok = !ferror(f);
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp_path, path) < 0) {
+    fprintf(stderr, "write(%s): %s\n", path, strerror(errno));
+    unlink(tmp_path);
+  }
+}
+
+
+void energy_open(const char *file) {
+  char    line[128], id[40], name[16], unit[4];
+  double  used, charged;
+  long    date = 0;
+  FILE    *f;
+  int     p, ac;
+
+  read_boot_id(boot_id, sizeof(boot_id));
+  today = local_day();
+  saved_at = boot_ms();
+  if (!file) return;
+  snprintf(path, sizeof(path), "%s", file);
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  if (!(f = fopen(path, "r"))) return;
+
+  id[0] = '\0';
+  unit[0] = '\0';
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "boot_id %39s", id) == 1 || sscanf(line, "date %ld", &date) == 1) continue;
+    if (sscanf(line, "ac %d", &ac) == 1) {
+      last_ac = ac;
+      continue;
+    }
+    if (sscanf(line, "unit %3s", unit) == 1) {
+      unit_amps = !strcmp(unit, "Ah");
+      continue;
+    }
+    /* totals of no known unit would be added to whatever comes */
+    if (!unit[0] || sscanf(line, "%15s %lf %lf", name, &used, &charged) != 3) continue;
+    for (p = 0; p < ENERGY_PERIODS && strcmp(name, period_names[p]); p++);
+    if (p == ENERGY_PERIODS) continue;
+    /* the boot and the day only go on if they are still the same */
+    if (p == ENERGY_BOOT && strcmp(id, boot_id)) continue;
+    if (p == ENERGY_DAY && date != today) continue;
+    totals[p][0] = used;
+    totals[p][1] = charged;
+  }
+  fclose(f);
+  DPRINTF("D: energy today %.0f uWh used, %.0f uWh charged\n", totals[ENERGY_DAY][0], totals[ENERGY_DAY][1])
+}
+
+
+void energy_close(void) {
+  if (dirty && path[0]) save(boot_ms());
+}
+
+
+void energy_update(const AcpiInfos *k, int nbat, int amps) {
+  long  now = boot_ms(), day = local_day();
+  int   bat, ac = k->ac_line_status == 1;
+
+  if (day != today) {
+    today = day;
+    totals[ENERGY_DAY][0] = totals[ENERGY_DAY][1] = 0;
+    dirty = 1;
+  }
+  if (last_ac != ac) {
+    if (last_ac == 1) totals[ENERGY_UNPLUGGED][0] = totals[ENERGY_UNPLUGGED][1] = 0;
+    last_ac = ac;
+    dirty = 1;
+  }
+  /* Wh and Ah don't add up, the totals start over in the new unit */
+  if (amps != unit_amps) {
+    if (unit_amps >= 0) {
+      DPRINTF("D: energy now counted in %s, totals reset\n", amps ? "Ah" : "Wh")
+      memset(totals, 0, sizeof(totals));
+    }
+    unit_amps = amps;
+    last_nbat = -1;
+    dirty = 1;
+  }
+  /* a battery came or went or the unit changed, the counters are not comparable */
+  if (nbat != last_nbat) {
+    memset(bats, 0, sizeof(bats));
+    last_nbat = nbat;
+  }
+  for (bat = 0; bat < nbat && bat < 2; bat++)
+    account(&bats[bat], k->battery_status[bat], k->power[bat], k->remain[bat], now);
+  if (dirty && path[0] && now - saved_at >= ENERGY_SAVE) save(now);
+}
+
+
+long energy_get(int period, int charged) {
+  return totals[period][charged != 0];
+}
+
+
+void energy_print(FILE *out) {
+  const char *unit = unit_amps == 1 ? "Ah" : "Wh";
+  int p;
+
+  fprintf(out, "energy %s used/charged:", unit);
+  for (p = 0; p < ENERGY_PERIODS; p++)
+    fprintf(out, " %s %.2f/%.2f", period_names[p], totals[p][0] / 1e6, totals[p][1] / 1e6);
+  fprintf(out, "\n%ld checks against the energy counter, %ld corrected, %ld gaps", checks, corrected, gaps);
+  if (last_ratio >= 0) fprintf(out, ", last %.0f%%", last_ratio * 100);
+  fputc('\n', out);
+}
@@ -0,0 +1,45 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdio.h>
+#include "wmbatteries.h"
+
+/*
+ * Energy used and charged, integrated over the power of every sample
+ * with the trapezoid rule. Each time a battery's energy counter moved
+ * by ENERGY_CHECK the integral is checked against it; when the two
+ * disagree by more than a third, or samples are too far apart to
+ * integrate (a suspend), the counter is taken instead. Totals are kept
+ * for the boot, the calendar day and the time since AC was unplugged,
+ * and saved to a small file at most every ENERGY_SAVE msec and on exit.
+ * The units are uWh, or uAh for batteries that report a current; the
+ * file records which, and a change of unit starts all totals over.
+ */
+enum { ENERGY_BOOT, ENERGY_DAY, ENERGY_UNPLUGGED, ENERGY_PERIODS };
+
+/* loads the totals saved in path, which may be NULL to keep none */
+void energy_open(const char *path);
+void energy_close(void);
+/* a sample, amps set if the batteries report a current */
+void energy_update(const AcpiInfos *k, int nbat, int amps);
+/* used, or charged if set, in one of the ENERGY_* periods */
+long energy_get(int period, int charged);
+void energy_print(FILE *out);
+
+#endif	/* ifndef ENERGY_H */
@@ -0,0 +1,202 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "governor.h"
+#include "latency.h"
+#include "wmbatteries.h"
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define WINDOW        60000   /* msec measured before a decision */
+#define MAX_STEPS     32
+
+static Knob     *knobs;
+static int      nknobs;
+static long     cpu_budget, wakeup_budget;
+static Cost     last;
+static long     start;        /* msec, of the current window */
+static long     start_cpu, start_switches;
+static unsigned long start_reads;
+static int      changes;
+
+/* the knobs turned so far, the newest is undone first */
+static struct {
+  Knob        *knob;
+  int         old;            /* msec before the step */
+  int         set;            /* msec after it, or -1 if it turned it off */
+} steps[MAX_STEPS];
+static int      nsteps;
+
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+static void usage(long *cpu, long *switches) {
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  *cpu = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000L +
+         ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+  *switches = ru.ru_nvcsw;
+}
+
+
+void governor_configure(long cpu, long wakeups) {
+  cpu_budget = cpu;
+  wakeup_budget = wakeups;
+}
+
+
+void governor_knobs(Knob *k, int n) {
+  knobs = k;
+  nknobs = n;
+}
+
+
+/* the running knob that wakes us up most often and can still give */
+static Knob *busiest(void) {
+  Knob  *k, *best = NULL;
+  int   i;
+
+  for (i = 0; i < nknobs; i++) {
+    k = &knobs[i];
+    if ((k->active && !*k->active) || (k->off && *k->off)) continue;
+    if (*k->msec >= k->max && !k->off) continue;
+    if (!best || *k->msec < *best->msec) best = k;
+  }
+  return best;
+}
+
+
+/* one step on 'k', 'why' says which budget */
+static void turn(Knob *k, const char *why) {
+  int old = *k->msec;
+
+  if (old >= k->max) {
+    *k->off = 1;
+    printf("%s over budget, %s turned off\n", why, k->name);
+  } else {
+    *k->msec = old * 2 < k->max ? old * 2 : k->max;
+    printf("%s over budget, %s %d -> %d msec\n", why, k->name, old, *k->msec);
+  }
+  fflush(stdout);
+  changes++;
+  if (nsteps < MAX_STEPS) {
+    steps[nsteps].knob = k;
+    steps[nsteps].old = old;
+    steps[nsteps].set = old >= k->max ? -1 : *k->msec;
+    nsteps++;
+  }
+}
+
+
+/*
+ * Takes back the newest step. A knob changed since, e.g. by a config
+ * reload, keeps its value and the step is just forgotten.
+ */
+static int undo(void) {
+  Knob  *k;
+
+  while (nsteps > 0) {
+    k = steps[--nsteps].knob;
+    if (steps[nsteps].set < 0) {
+      if (!*k->off) continue;
+      *k->off = 0;
+      printf("cost under budget, %s turned on again\n", k->name);
+    } else {
+      if (*k->msec != steps[nsteps].set) continue;
+      *k->msec = steps[nsteps].old;
+      printf("cost under budget, %s %d -> %d msec\n", k->name,
+             steps[nsteps].set, *k->msec);
+    }
+    fflush(stdout);
+    changes++;
+    return 1;
+  }
+  return 0;
+}
+
+
+int governor_check(void) {
+  long  now = now_ms(), cpu, switches, span;
+  unsigned long reads;
+  Knob  *k;
+
+  if (!start) {
+    start = now;
+    usage(&start_cpu, &start_switches);
+    start_reads = latency_sum();
+    return 0;
+  }
+  if ((span = now - start) < WINDOW) return 0;
+
+  usage(&cpu, &switches);
+  reads = latency_sum();
+  last.cpu = (cpu - start_cpu) * 1000 / span;
+  last.wakeups = (switches - start_switches) * 60000 / span;
+  last.reads = (reads - start_reads) * 1000 / span;
+  start = now;
+  start_cpu = cpu;
+  start_switches = switches;
+  start_reads = reads;
+  DPRINTF("D: %ld ppm CPU, %ld wakeups/min, %ld usec/s reading\n",
+          last.cpu, last.wakeups, last.reads)
+
+  if (cpu_budget && last.cpu > cpu_budget) {
+    /* CPU that mostly goes into reading sysfs is saved by sampling less */
+    k = &knobs[0];
+    if (last.reads * 2 < last.cpu || *k->msec >= k->max) k = busiest();
+    if (k) {
+      turn(k, "CPU");
+      return 1;
+    }
+  }
+  if (wakeup_budget && last.wakeups > wakeup_budget && (k = busiest())) {
+    turn(k, "wakeups");
+    return 1;
+  }
+  /* a step doubles an interval, so below half the budget it can go back */
+  if ((!cpu_budget || last.cpu * 2 < cpu_budget) &&
+      (!wakeup_budget || last.wakeups * 2 < wakeup_budget))
+    return undo();
+  return 0;
+}
+
+
+void governor_cost(Cost *cost) {
+  *cost = last;
+}
+
+
+void governor_print(FILE *out) {
+  fprintf(out, "cost: %ld ppm CPU (budget %ld), %ld wakeups/min (budget %ld), "
+          "%ld usec/s reading sysfs, %d changes\n",
+          last.cpu, cpu_budget, last.wakeups, wakeup_budget, last.reads, changes);
+  fflush(out);
+}
@@ -0,0 +1,58 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdio.h>
+
+/*
+ * Keeps wmbatteries' own cost within a budget. Once a minute the CPU time
+ * and the voluntary context switches (one per wakeup) of all threads are
+ * taken from getrusage(), with the time spent in sysfs reads from the
+ * latency histograms. While a budget is exceeded every minute one knob
+ * is turned: the interval of the busiest active timer is doubled up to
+ * its limit, then the timer is stopped if it may be. Once the cost is
+ * below half of every budget the steps are taken back, the newest first,
+ * one a minute. Each step is logged. The first knob is the sampling
+ * interval, which goes first when most of the CPU time is spent reading
+ * sysfs.
+ */
+typedef struct Knob {
+  const char  *name;
+  int         *msec;
+  int         max;            /* doubled up to this */
+  int         *off;           /* set once past max, NULL if it must run */
+  const int   *active;        /* the timer only runs while set, NULL if always */
+} Knob;
+
+typedef struct Cost {
+  long        cpu;            /* usec of CPU per second, ppm */
+  long        wakeups;        /* per minute */
+  long        reads;          /* usec of sysfs reads per second */
+} Cost;
+
+/* budgets in ppm CPU and wakeups per minute, 0 disables one */
+void governor_configure(long cpu, long wakeups);
+void governor_knobs(Knob *knobs, int n);
+/* call on every wakeup, returns 1 if it turned a knob */
+int  governor_check(void);
+/* the last full minute */
+void governor_cost(Cost *cost);
+void governor_print(FILE *out);
+
+#endif	/* ifndef GOVERNOR_H */
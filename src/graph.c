@@ -0,0 +1,181 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "graph.h"
+#include "dockapp.h"
+#include <string.h>
+#include <time.h>
+
+typedef struct Range {
+  long      period;                 /* msec per column */
+  long      start;                  /* msec, of the column being filled */
+  long      sum;                    /* power of the samples in it */
+  int       n;
+  int       charge;
+  long      power[GRAPH_WIDTH];     /* ring, 'head' is the oldest column */
+  signed char level[GRAPH_WIDTH];
+  int       head;
+  long      scale;                  /* uW at full height */
+  int       dirty[DOCKAPP_MAX_DISPLAYS]; /* bitmap needs a full render */
+} Range;
+
+typedef struct Bitmaps {
+  Pixmap    bitmap[GRAPH_RANGES];
+  GC        bit_gc;                 /* depth 1, for the bitmaps */
+  GC        fill_gc;                /* stipples a bitmap onto the canvas */
+} Bitmaps;
+
+static Range    ranges[GRAPH_RANGES] = {
+  { 5000 }, { 60000 }, { 600000 }   /* 3.5 minutes, 43 minutes, 7 hours */
+};
+static Bitmaps  bitmaps[DOCKAPP_MAX_DISPLAYS];
+static int      nbitmaps;
+
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+void graph_open(void) {
+  Bitmaps *b = &bitmaps[dockapp_current()];
+  int r;
+
+  for (r = 0; r < GRAPH_RANGES; r++) {
+    b->bitmap[r] = XCreatePixmap(display, DefaultRootWindow(display), GRAPH_WIDTH, GRAPH_HEIGHT, 1);
+    ranges[r].dirty[dockapp_current()] = 1;
+  }
+  b->bit_gc = XCreateGC(display, b->bitmap[0], 0, NULL);
+  b->fill_gc = XCreateGC(display, DefaultRootWindow(display), 0, NULL);
+  if (dockapp_current() >= nbitmaps) nbitmaps = dockapp_current() + 1;
+}
+
+
+/* column 'x' of the bitmap from ring entry 'i' */
+static void draw_column(Bitmaps *b, const Range *g, Pixmap bm, int x, int i) {
+  long h = g->power[i] > 0 ? (g->power[i] * GRAPH_HEIGHT + g->scale - 1) / g->scale : 0;
+  int  y;
+
+  XSetForeground(display, b->bit_gc, 0);
+  XFillRectangle(display, bm, b->bit_gc, x, 0, 1, GRAPH_HEIGHT);
+  XSetForeground(display, b->bit_gc, 1);
+  if (h > GRAPH_HEIGHT) h = GRAPH_HEIGHT;
+  if (h) XFillRectangle(display, bm, b->bit_gc, x, GRAPH_HEIGHT - h, 1, h);
+  if (g->level[i] >= 0) {
+    /* the charge dot stays visible inside a bar */
+    y = GRAPH_HEIGHT - 1 - g->level[i] * (GRAPH_HEIGHT - 1) / 100;
+    XSetForeground(display, b->bit_gc, y >= GRAPH_HEIGHT - h ? 0 : 1);
+    XDrawPoint(display, bm, b->bit_gc, x, y);
+  }
+}
+
+
+/* brings the bitmap of range r on the current display up to date */
+static void render(Range *g, int r, int columns) {
+  Bitmaps *b = &bitmaps[dockapp_current()];
+  Pixmap  bm = b->bitmap[r];
+  int     x;
+
+  if (g->dirty[dockapp_current()]) {
+    g->dirty[dockapp_current()] = 0;
+    columns = GRAPH_WIDTH;
+  } else if (columns < GRAPH_WIDTH) {
+    XCopyArea(display, bm, bm, b->bit_gc, columns, 0, GRAPH_WIDTH - columns, GRAPH_HEIGHT, 0, 0);
+  }
+  for (x = GRAPH_WIDTH - columns; x < GRAPH_WIDTH; x++)
+    draw_column(b, g, bm, x, (g->head + x) % GRAPH_WIDTH);
+}
+
+
+/* power of two watts that fits the highest column */
+static long fit_scale(const Range *g) {
+  long max = 0, scale = 1000000;
+  int  i;
+
+  for (i = 0; i < GRAPH_WIDTH; i++)
+    if (g->power[i] > max) max = g->power[i];
+  while (scale < max) scale *= 2;
+  return scale;
+}
+
+
+unsigned graph_add(long power, int charge) {
+  unsigned  advanced = 0;
+  long      now = now_ms(), value, scale;
+  int       cur = dockapp_current();
+  int       r, d, k, i;
+  Range     *g;
+
+  for (r = 0; r < GRAPH_RANGES; r++) {
+    g = &ranges[r];
+    if (!g->start) {
+      g->start = now;
+      memset(g->level, -1, sizeof(g->level));
+    }
+    g->sum += power > 0 ? power : 0;
+    g->n++;
+    g->charge = charge;
+    /* a little early is fine, the samples won't line up exactly */
+    k = (now - g->start + g->period / 4) / g->period;
+    if (!k) continue;
+    g->start += k * g->period;
+    value = g->sum / g->n;
+    g->sum = g->n = 0;
+    /* columns without a sample, e.g. in deep idle, hold the value */
+    if (k > GRAPH_WIDTH) k = GRAPH_WIDTH;
+    for (i = 0; i < k; i++) {
+      g->power[g->head] = value;
+      g->level[g->head] = g->charge;
+      g->head = (g->head + 1) % GRAPH_WIDTH;
+    }
+    if ((scale = fit_scale(g)) != g->scale) {
+      g->scale = scale;
+      for (d = 0; d < nbitmaps; d++) g->dirty[d] = 1;
+    }
+    for (d = 0; d < nbitmaps; d++) {
+      if (dockapp_select(d)) render(g, r, k);
+    }
+    advanced |= 1u << r;
+  }
+  if (nbitmaps) dockapp_select(cur);
+  return advanced;
+}
+
+
+void graph_draw(Pixmap dst, int range, int x, int y, unsigned long bg, unsigned long fg) {
+  Bitmaps *b = &bitmaps[dockapp_current()];
+
+  if (ranges[range].dirty[dockapp_current()]) render(&ranges[range], range, 0);
+  XSetFillStyle(display, b->fill_gc, FillSolid);
+  XSetForeground(display, b->fill_gc, bg);
+  XFillRectangle(display, dst, b->fill_gc, x, y, GRAPH_WIDTH, GRAPH_HEIGHT);
+  XSetForeground(display, b->fill_gc, fg);
+  XSetStipple(display, b->fill_gc, b->bitmap[range]);
+  XSetTSOrigin(display, b->fill_gc, x, y);
+  XSetFillStyle(display, b->fill_gc, FillStippled);
+  XFillRectangle(display, dst, b->fill_gc, x, y, GRAPH_WIDTH, GRAPH_HEIGHT);
+}
@@ -0,0 +1,43 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <X11/Xlib.h>
+
+/*
+ * Power draw and charge history for the scroll wheel view. Every range
+ * keeps GRAPH_WIDTH columns of a fixed time span, drawn as power bars with
+ * the charge level as an inverted dot. Each display holds one bitmap per
+ * range that is shifted by the columns a sample completes, so only those
+ * get drawn; the whole bitmap is only redone when the power scale changes.
+ */
+#define GRAPH_WIDTH   43
+#define GRAPH_HEIGHT  9
+#define GRAPH_RANGES  3
+
+/* bitmaps for the current display, after its window was opened */
+void graph_open(void);
+/*
+ * A sample: power in uW (or uA), charge in percent or -1. Returns a mask
+ * of the ranges that got new columns. Leaves the current display alone.
+ */
+unsigned graph_add(long power, int charge);
+/* the range onto 'dst' of the current display, lit pixels in 'fg' */
+void graph_draw(Pixmap dst, int range, int x, int y, unsigned long bg, unsigned long fg);
+
+#endif	/* ifndef GRAPH_H */
@@ -0,0 +1,318 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "health.h"
+#include "wmbatteries.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define HEALTH_MAGIC    "WMBH\1\0\0\0"  /* magic and format version */
+#define SNAPSHOT_EVERY  (24 * 3600)     /* seconds between unchanged snapshots */
+#define SNAPSHOT_MIN    3600            /* ... and between changed ones */
+#define MIN_DEPTH       5               /* shallower (dis)charges are not logged */
+#define MIN_LOAD_STEP   100000          /* uA, load change needed for a sag estimate */
+
+#define REC_SNAPSHOT    1
+#define REC_CYCLE       2               /* a discharge */
+#define REC_RECHARGE    3
+#define REC_CHARGE      0x80            /* capacities in mAh instead of mWh */
+
+/* 20 bytes on disk, in host byte order */
+typedef struct HealthRecord {
+  uint32_t  time;
+  uint8_t   bat;
+  uint8_t   kind;
+  uint16_t  cycles;       /* as reported by the kernel, 0 if unknown */
+  uint32_t  full;         /* mWh or mAh */
+  uint32_t  design;
+  uint16_t  resistance;   /* mOhm, 0 if not estimated yet */
+  uint8_t   start;        /* REC_CYCLE, REC_RECHARGE: charge in percent */
+  uint8_t   end;          /* before and after */
+} HealthRecord;
+
+typedef struct Tracker {
+  HealthRecord last;      /* last snapshot written */
+  int       status;
+  long      volt;         /* uV */
+  long      current;      /* uA */
+  double    resistance;   /* Ohm, smoothed */
+  int       start;        /* percent when the (dis)charge began, -1 if none */
+  int       percent;
+} Tracker;
+
+static int      log_fd = -1;
+static Tracker  trackers[2];
+
+
+/* reads POWER_SUPPLY_<key>=<value> from a uevent text */
+static int get_long(const char *uevent, const char *key, long *val) {
+  const char *p = uevent;
+  int len = strlen(key);
+
+  while ((p = strstr(p, "POWER_SUPPLY_"))) {
+    p += 13;
+    if (!strncmp(p, key, len) && p[len] == '=') {
+      *val = strtol(p + len + 1, NULL, 10);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+static int read_header(int fd) {
+  char magic[8];
+
+  return read(fd, magic, 8) == 8 && !memcmp(magic, HEALTH_MAGIC, 8);
+}
+
+
+int health_open(const char *path) {
+  HealthRecord r;
+  off_t size;
+  int fd, bat;
+
+  for (bat = 0; bat < 2; bat++) {
+    memset(&trackers[bat], 0, sizeof(Tracker));
+    trackers[bat].start = -1;
+  }
+  if ((fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0) {
+    perror(path);
+    return -1;
+  }
+  if (lseek(fd, 0, SEEK_END) == 0) {
+    if (write(fd, HEALTH_MAGIC, 8) != 8) {
+      perror(path);
+      close(fd);
+      return -1;
+    }
+  } else {
+    lseek(fd, 0, SEEK_SET);
+    if (!read_header(fd)) {
+      fprintf(stderr, "%s is not a wmbatteries health log\n", path);
+      close(fd);
+      return -1;
+    }
+    /* a crash in the middle of a write leaves part of a record behind */
+    if ((size = lseek(fd, 0, SEEK_END)) >= 0 && (size - 8) % sizeof(r)) {
+      fprintf(stderr, "%s: dropping a truncated record at the end\n", path);
+      if (ftruncate(fd, size - (size - 8) % sizeof(r)) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+      }
+    }
+    lseek(fd, 8, SEEK_SET);
+    /* pick up where the last run left off, so restarts add no snapshots */
+    while (read(fd, &r, sizeof(r)) == sizeof(r))
+      if ((r.kind & ~REC_CHARGE) == REC_SNAPSHOT && r.bat < 2) {
+        trackers[r.bat].last = r;
+        trackers[r.bat].resistance = r.resistance / 1000.0;
+      }
+  }
+  log_fd = fd;
+  DPRINTF("D: battery health log '%s'\n", path)
+  return 0;
+}
+
+
+void health_close(void) {
+  if (log_fd < 0) return;
+  close(log_fd);
+  log_fd = -1;
+}
+
+
+static void append(const HealthRecord *r) {
+  if (write(log_fd, r, sizeof(*r)) != sizeof(*r)) {
+    DPRINTF("health log write error\n")
+  }
+}
+
+
+/* the voltage drops with the load by I*R, compare two loads */
+static void estimate_resistance(Tracker *t, long volt, long current) {
+  double r;
+
+  if (t->status != DISCHARGING || t->volt <= 0 || volt <= 0 ||
+      labs(current - t->current) < MIN_LOAD_STEP) return;
+  r = (double)(t->volt - volt) / (double)(current - t->current);
+  if (r < 0.005 || r > 2.0) return;
+  t->resistance = t->resistance > 0 ? t->resistance * 0.9 + r * 0.1 : r;
+}
+
+
+void health_sample(int bat, const char *uevent) {
+  Tracker *t = &trackers[bat];
+  HealthRecord r;
+  long  full, design, now, cycles = 0, volt = 0, current = 0, power;
+  int   status, charge = 0;
+  time_t stamp;
+
+  if (log_fd < 0) return;
+  if (!get_long(uevent, "ENERGY_FULL", &full) ||
+      !get_long(uevent, "ENERGY_FULL_DESIGN", &design) ||
+      !get_long(uevent, "ENERGY_NOW", &now)) {
+    if (!get_long(uevent, "CHARGE_FULL", &full) ||
+        !get_long(uevent, "CHARGE_FULL_DESIGN", &design) ||
+        !get_long(uevent, "CHARGE_NOW", &now)) return;
+    charge = REC_CHARGE;
+  }
+  if (full <= 0) return;
+  get_long(uevent, "CYCLE_COUNT", &cycles);
+  get_long(uevent, "VOLTAGE_NOW", &volt);
+  if (!get_long(uevent, "CURRENT_NOW", &current) && volt > 0 &&
+      get_long(uevent, "POWER_NOW", &power))
+    current = (long long)power * 1000000 / volt;
+
+  status = strstr(uevent, "POWER_SUPPLY_STATUS=Discharging") ? DISCHARGING :
+           strstr(uevent, "POWER_SUPPLY_STATUS=Charging") ? CHARGING : UNKNOWN;
+  stamp = time(NULL);
+
+  if (status == DISCHARGING) estimate_resistance(t, volt, current);
+  t->volt = volt;
+  t->current = current;
+  t->percent = now * 100 / full;
+
+  memset(&r, 0, sizeof(r));
+  r.time = stamp;
+  r.bat = bat;
+  r.cycles = cycles;
+  r.full = full / 1000;
+  r.design = design / 1000;
+  r.resistance = t->resistance * 1000 + 0.5;
+
+  /* a (dis)charge ends with any other state, log it if it was deep enough */
+  if (status != t->status) {
+    if (t->start >= 0 && abs(t->start - t->percent) >= MIN_DEPTH) {
+      r.kind = (t->status == DISCHARGING ? REC_CYCLE : REC_RECHARGE) | charge;
+      r.start = t->start;
+      r.end = t->percent;
+      append(&r);
+    }
+    t->start = status == DISCHARGING || status == CHARGING ? t->percent : -1;
+  }
+  t->status = status;
+
+  if (stamp - t->last.time >= SNAPSHOT_EVERY ||
+      (stamp - t->last.time >= SNAPSHOT_MIN &&
+       (r.full != t->last.full || r.design != t->last.design || r.cycles != t->last.cycles ||
+        (r.resistance && abs(r.resistance - t->last.resistance) * 10 > t->last.resistance)))) {
+    r.kind = REC_SNAPSHOT | charge;
+    r.start = r.end = 0;
+    append(&r);
+    t->last = r;
+  }
+}
+
+
+typedef struct Summary {
+  HealthRecord first, last;
+  int       snapshots;
+  int       discharges;
+  long      depth;          /* sum of all discharge depths in percent */
+  int       charges;
+  long      charged;        /* sum of all charge depths in percent */
+  uint16_t  first_res;
+} Summary;
+
+
+static void print_summary(int bat, const Summary *s) {
+  const char *unit = s->last.kind & REC_CHARGE ? "Ah" : "Wh";
+  char  since[32];
+  time_t t = s->first.time;
+  double months, wear;
+
+  strftime(since, sizeof(since), "%Y-%m-%d", localtime(&t));
+  printf("BAT%d: %d snapshots since %s\n", bat, s->snapshots, since);
+  printf("  full capacity  %.1f %s (was %.1f %s), design %.1f %s",
+         s->last.full / 1000.0, unit, s->first.full / 1000.0, unit,
+         s->last.design / 1000.0, unit);
+  if (s->last.design)
+    printf(", health %.1f%%", s->last.full * 100.0 / s->last.design);
+  printf("\n");
+
+  wear = s->first.full ? (double)((long)s->first.full - (long)s->last.full) * 100.0 / s->first.full : 0;
+  months = (s->last.time - s->first.time) / (30.0 * 24 * 3600);
+  printf("  wear           %.1f%%", wear);
+  if (months >= 1) printf(", %.2f%% per month", wear / months);
+  if (s->last.cycles > s->first.cycles)
+    printf(", %.2f%% per 100 cycles", wear * 100.0 / (s->last.cycles - s->first.cycles));
+  printf("\n");
+
+  printf("  cycles         %u reported, %d discharges", s->last.cycles, s->discharges);
+  if (s->discharges)
+    printf(" averaging %ld%% (%.1f full cycles)", s->depth / s->discharges, s->depth / 100.0);
+  printf(", %d charges", s->charges);
+  if (s->charges)
+    printf(" averaging %ld%%", s->charged / s->charges);
+  printf("\n");
+  if (s->last.resistance)
+    printf("  resistance     %u mOhm (first estimate %u mOhm)\n", s->last.resistance, s->first_res);
+}
+
+
+int health_report(const char *path) {
+  Summary s[2];
+  HealthRecord r;
+  int fd, bat, found = 0;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    perror(path);
+    return 1;
+  }
+  if (!read_header(fd)) {
+    fprintf(stderr, "%s is not a wmbatteries health log\n", path);
+    close(fd);
+    return 1;
+  }
+  memset(s, 0, sizeof(s));
+  while (read(fd, &r, sizeof(r)) == sizeof(r)) {
+    if (r.bat > 1) continue;
+    if ((r.kind & ~REC_CHARGE) == REC_CYCLE) {
+      s[r.bat].discharges++;
+      s[r.bat].depth += r.start - r.end;
+    } else if ((r.kind & ~REC_CHARGE) == REC_RECHARGE) {
+      s[r.bat].charges++;
+      s[r.bat].charged += r.end - r.start;
+    } else if ((r.kind & ~REC_CHARGE) == REC_SNAPSHOT) {
+      if (!s[r.bat].snapshots++) s[r.bat].first = r;
+      if (!s[r.bat].first_res) s[r.bat].first_res = r.resistance;
+      s[r.bat].last = r;
+    }
+  }
+  close(fd);
+
+  for (bat = 0; bat < 2; bat++) {
+    if (!s[bat].snapshots) continue;
+    print_summary(bat, &s[bat]);
+    found = 1;
+  }
+  if (!found) printf("%s: no records yet\n", path);
+  return 0;
+}
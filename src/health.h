@@ -0,0 +1,33 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+/*
+ * Battery wear tracking. Every sample's uevent text is fed in; capacity,
+ * design capacity, cycle count and the internal resistance (estimated
+ * from the voltage sag between samples with different load) are appended
+ * to a small binary log once a day or when they change, together with a
+ * record for every discharge and every charge.
+ */
+int  health_open(const char *path);
+void health_sample(int bat, const char *uevent);
+void health_close(void);
+/* prints a summary of the log on stdout, returns the exit status */
+int  health_report(const char *path);
+
+#endif	/* ifndef HEALTH_H */
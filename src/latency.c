@@ -0,0 +1,139 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "latency.h"
+#include <string.h>
+
+typedef struct Histogram {
+  char      name[40];
+  unsigned  count[LATENCY_BUCKETS];
+  unsigned  total;
+  unsigned long sum;          /* usec */
+  long      max;
+  int       logged;           /* highest bucket reported so far */
+} Histogram;
+
+static Histogram  hists[LATENCY_SOURCES];
+static int        nhists;
+static long       threshold;
+
+
+/* the last two path components, e.g. BAT0/uevent or thermal_zone3/temp */
+static const char *short_name(const char *path) {
+  const char *p = path + strlen(path);
+  int slashes = 0;
+
+  while (p > path && (p[-1] != '/' || ++slashes < 2)) p--;
+  return p;
+}
+
+
+int latency_source(const char *path) {
+  const char *name = short_name(path);
+  Histogram *h;
+  int i, n = __atomic_load_n(&nhists, __ATOMIC_ACQUIRE);
+
+  for (i = 0; i < n; i++)
+    if (!strcmp(hists[i].name, name)) return i;
+  if (n == LATENCY_SOURCES) return -1;
+  h = &hists[n];
+  snprintf(h->name, sizeof(h->name), "%s", name);
+  h->logged = -1;
+  /* the name has to be complete before a reader sees the entry */
+  __atomic_store_n(&nhists, n + 1, __ATOMIC_RELEASE);
+  return n;
+}
+
+
+void latency_configure(long usec) {
+  threshold = usec;
+}
+
+
+void latency_add(int id, long usec) {
+  Histogram *h;
+  int b;
+
+  if (id < 0) return;
+  h = &hists[id];
+  if (usec < 0) usec = 0;
+  b = usec ? 8 * sizeof(long) - __builtin_clzl(usec) : 0;
+  if (b >= LATENCY_BUCKETS) b = LATENCY_BUCKETS - 1;
+  __atomic_fetch_add(&h->count[b], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->total, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->sum, usec, __ATOMIC_RELAXED);
+  if (usec > h->max) __atomic_store_n(&h->max, usec, __ATOMIC_RELAXED);
+
+  /* once per new order of magnitude, a slow EC answers like that every time */
+  if (threshold && usec >= threshold && b > h->logged) {
+    h->logged = b;
+    printf("reading %s took %ld usec\n", h->name, usec);
+    fflush(stdout);
+  }
+}
+
+
+void latency_print(FILE *out) {
+  Histogram *h;
+  int i, b, last, n = __atomic_load_n(&nhists, __ATOMIC_ACQUIRE);
+
+  fprintf(out, "%-24s %8s %8s %8s  usec < 1 2 4 8 ...\n", "source", "reads", "mean", "max");
+  for (i = 0; i < n; i++) {
+    h = &hists[i];
+    fprintf(out, "%-24s %8u %8lu %8ld ", h->name, h->total,
+            h->total ? h->sum / h->total : 0, h->max);
+    for (last = LATENCY_BUCKETS - 1; last > 0 && !h->count[last]; last--);
+    for (b = 0; b <= last; b++) fprintf(out, " %u", h->count[b]);
+    fputc('\n', out);
+  }
+  fflush(out);
+}
+
+
+unsigned long latency_sum(void) {
+  unsigned long sum = 0;
+  int i, n = __atomic_load_n(&nhists, __ATOMIC_ACQUIRE);
+
+  for (i = 0; i < n; i++) sum += __atomic_load_n(&hists[i].sum, __ATOMIC_RELAXED);
+  return sum;
+}
+
+
+int latency_json(char *buf, int len) {
+  Histogram *h;
+  int i, b, last, pos, n = __atomic_load_n(&nhists, __ATOMIC_ACQUIRE);
+
+  pos = snprintf(buf, len, "{\"latency\":[");
+  for (i = 0; i < n && pos < len; i++) {
+    h = &hists[i];
+    pos += snprintf(buf + pos, len - pos, "%s{\"source\":\"%s\",\"reads\":%u,\"sum\":%lu,\"max\":%ld,\"buckets\":[",
+                    i ? "," : "", h->name, h->total, h->sum, h->max);
+    for (last = LATENCY_BUCKETS - 1; last > 0 && !h->count[last]; last--);
+    for (b = 0; b <= last && pos < len; b++)
+      pos += snprintf(buf + pos, len - pos, "%s%u", b ? "," : "", h->count[b]);
+    if (pos < len) pos += snprintf(buf + pos, len - pos, "]}");
+  }
+  if (pos < len) pos += snprintf(buf + pos, len - pos, "]}\n");
+  return pos < len ? pos : -1;
+}
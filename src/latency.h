@@ -0,0 +1,42 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+
+/*
+ * Read latency histograms, one per sysfs file. Bucket k counts reads that
+ * took less than 2^k usec (and at least 2^(k-1)), the last one everything
+ * slower. Adding a read is a handful of instructions and safe from the
+ * sampler thread while the main thread prints the tables.
+ */
+#define LATENCY_SOURCES   48
+#define LATENCY_BUCKETS   24      /* up to 8 seconds */
+
+/* returns the id of the histogram for 'path', -1 if the table is full */
+int  latency_source(const char *path);
+void latency_add(int id, long usec);
+/* reads slower than 'usec' are logged, 0 disables it */
+void latency_configure(long usec);
+void latency_print(FILE *out);
+/* usec spent in all reads so far */
+unsigned long latency_sum(void);
+/* one JSON line for the socket, returns its length */
+int  latency_json(char *buf, int len);
+
+#endif	/* ifndef LATENCY_H */
@@ -0,0 +1,210 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "launcher.h"
+#include "dockapp.h"
+#include "wmbatteries.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#ifdef __linux
+# include <sys/signalfd.h>
+#endif
+
+#define MAX_COMMANDS 4
+#define MAX_ARGS     32
+#define SHELL_CHARS  "|&;<>()$`\\\"'*?[]#~=%{}\n"
+
+extern char **environ;
+
+typedef struct Command {
+  char        *cmd;
+  pid_t       pid;       /* 0 when not running */
+  long        last;      /* msec timestamp of the last launch */
+} Command;
+
+static Command  commands[MAX_COMMANDS];
+static unsigned min_interval = 0;
+static int      direct_exec  = 1;
+static int      kernel_reaps = 0;   /* SA_NOCLDWAIT, no exit to see */
+static sigset_t child_mask;
+
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+static void reap_children(void) {
+  pid_t pid;
+  int   status, i;
+
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    for (i = 0; i < MAX_COMMANDS; i++) {
+      if (commands[i].pid == pid) {
+        DPRINTF("D: '%s' exited with status %d\n", commands[i].cmd, status)
+        commands[i].pid = 0;
+      }
+    }
+  }
+}
+
+
+#ifdef __linux
+static void read_signalfd(int fd, void *data) {
+  struct signalfd_siginfo si;
+
+  while (read(fd, &si, sizeof(si)) == sizeof(si));
+  reap_children();
+}
+#endif
+
+
+void launcher_configure(unsigned interval, int direct) {
+  min_interval = interval;
+  direct_exec = direct;
+}
+
+
+void launcher_init(void) {
+#ifdef __linux
+  int fd;
+#endif
+
+  sigemptyset(&child_mask);
+#ifdef __linux
+  /* SIGCHLD is only delivered through the signalfd, handled in the loop */
+  sigaddset(&child_mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &child_mask, NULL);
+  if ((fd = signalfd(-1, &child_mask, SFD_NONBLOCK | SFD_CLOEXEC)) >= 0 &&
+      dockapp_watch_fd(fd, read_signalfd, NULL))
+    return;
+  sigprocmask(SIG_UNBLOCK, &child_mask, NULL);
+  sigemptyset(&child_mask);
+#endif
+  /* fall back to letting the kernel reap our children */
+  {
+    struct sigaction sa;
+
+    sa.sa_handler = SIG_IGN;
+#ifdef SA_NOCLDWAIT
+    sa.sa_flags = SA_NOCLDWAIT;
+#else
+    sa.sa_flags = 0;
+#endif
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+  }
+  kernel_reaps = 1;
+}
+
+
+/* split a command without shell syntax into argv, in place */
+static int split_args(char *buf, char **argv) {
+  int argc = 0;
+  char *ptr;
+
+  for (ptr = strtok(buf, " \t"); ptr; ptr = strtok(NULL, " \t")) {
+    if (argc == MAX_ARGS) return 0;
+    argv[argc++] = ptr;
+  }
+  argv[argc] = NULL;
+  return argc;
+}
+
+
+int launcher_run(const char *cmd) {
+  posix_spawnattr_t attr;
+  sigset_t  empty;
+  Command   *c = NULL;
+  char      buf[512];
+  char      *argv[MAX_ARGS + 1];
+  pid_t     pid;
+  long      now = now_ms();
+  int       i, err, shell;
+
+  if (cmd == NULL) return 1;
+
+  for (i = 0; i < MAX_COMMANDS; i++) {
+    if (commands[i].cmd && !strcmp(commands[i].cmd, cmd)) { c = &commands[i]; break; }
+    if (!c && commands[i].cmd == NULL) c = &commands[i];
+  }
+  if (c == NULL) c = &commands[0];
+  if (c->cmd && !strcmp(c->cmd, cmd)) {
+    /* without a wait for it, a child is gone once nothing has its pid */
+    if (c->pid && kernel_reaps && kill(c->pid, 0) < 0 && errno == ESRCH) c->pid = 0;
+    if (c->pid) {
+      DPRINTF("D: '%s' still running, not started again\n", cmd)
+      return 1;
+    }
+    if (now - c->last < (long)min_interval) {
+      DPRINTF("D: '%s' rate limited\n", cmd)
+      return 1;
+    }
+  }
+
+  shell = !direct_exec || strpbrk(cmd, SHELL_CHARS) || strlen(cmd) >= sizeof(buf);
+  if (shell) {
+    argv[0] = "sh";
+    argv[1] = "-c";
+    argv[2] = (char *)cmd;
+    argv[3] = NULL;
+  } else {
+    strcpy(buf, cmd);
+    if (!split_args(buf, argv)) return -1;
+  }
+
+  /* the child must not inherit the blocked SIGCHLD */
+  sigemptyset(&empty);
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &empty);
+  posix_spawnattr_setsigdefault(&attr, &child_mask);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+  if (shell)
+    err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+  else
+    err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+  posix_spawnattr_destroy(&attr);
+  if (err) {
+    fprintf(stderr, "can't run '%s': %s\n", cmd, strerror(err));
+    return -1;
+  }
+
+  if (!c->cmd || strcmp(c->cmd, cmd)) {
+    free(c->cmd);
+    if (!((c->cmd = strdup(cmd)))) exit(-1);
+  }
+  c->pid = pid;
+  c->last = now;
+  return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+/*
+ * Runs the notify/suspend commands with posix_spawn() and reaps them from
+ * the main loop. A command is not started again while a previous instance
+ * is still running or was started less than 'min_interval' msec ago.
+ * Commands without shell metacharacters are executed directly when
+ * 'direct' is set, otherwise through /bin/sh -c.
+ */
+void launcher_init(void);
+void launcher_configure(unsigned min_interval, int direct);
+int  launcher_run(const char *cmd);
+
+#endif	/* ifndef LAUNCHER_H */
@@ -32,31 +32,55 @@
 #endif
 
 #ifdef __STRICT_ANSI__
-# define _XOPEN_SOURCE
+# define _GNU_SOURCE
 #endif
 
 #include "files.h"
+#include "wmbatteries.h"
 #include "defaults.h"
 #include "dockapp.h"
+#include "server.h"
+#include "shmstate.h"
+#include "metrics.h"
+#include "upower.h"
+#include "launcher.h"
+#include "options.h"
+#include "thermal.h"
+#include "uevent.h"
+#include "stream.h"
+#include "health.h"
+#include "sampler.h"
+#include "sysread.h"
+#include "latency.h"
+#include "schedule.h"
+#include "alarm.h"
+#include "policy.h"
+#include "procs.h"
+#include "energy.h"
+#include "graph.h"
+#include "governor.h"
+#include <limits.h>
 #include <signal.h>
-#include "backlight_on.xpm"
-#include "backlight_off.xpm"
-#include "parts.xpm"
+#include "backlight_on_img.h"
+#include "backlight_off_img.h"
+#include "parts_img.h"
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <fcntl.h>
 
 #ifdef __linux
 # include <sys/stat.h>
+# include <sys/signalfd.h>
 # include <X11/XKBlib.h>
 #endif
 
-#define CHARGING    3
-#define DISCHARGING 1
-#define UNKNOWN     0
-
 #define RATE 0
 #define TEMP 1
+#define ENERGY 2
+#define MODES 3
 
 #define NONE     0
 #define STATE_OK 1
@@ -64,62 +88,192 @@
 #define BAT_OK   3
 
 #define SIZE      58
-#define MAXSTRLEN 512
-
-#ifdef DEBUG
-# define DDOT() { printf("."); fflush(stdout); }
-# define DPRINTF(...) { printf(__VA_ARGS__); fflush(stdout); }
-#else
-# define DPRINTF(...)
-#endif
-
-typedef struct AcpiInfos {
-  const char  driver_version[10];
-  int         ac_line_status;
-  int         battery_status[2];
-  int         battery_percentage[2];
-  long        rate[2];
-  long        *ratehist[2];
-  long        remain[2];
-  long        currcap[2];
-  int         thermal_temp;
-  int         thermal_state;
-  int         hours_left;
-  int         minutes_left;
-  int         low;
-} AcpiInfos;
+#define MAXSTRLEN 1024
 
 typedef enum { LIGHTOFF, LIGHTON } light;
 
 
+/* pixmaps of the current display, see select_display() */
 Pixmap pixmap;
 Pixmap backdrop_on;
 Pixmap backdrop_off;
 Pixmap parts;
 Pixmap mask;
+
+typedef struct Canvas {
+  Pixmap    pixmap;
+  Pixmap    backdrop_on;
+  Pixmap    backdrop_off;
+  Pixmap    parts;
+  unsigned  cns_state;
+  int       xkb_event;    /* XKB event base, 0 if no indicator events */
+  unsigned long lcd_off, lcd_on, lcd_ink;  /* graph colours */
+} Canvas;
+
+static Canvas   canvases[DOCKAPP_MAX_DISPLAYS];
+static char     *display_names[DOCKAPP_MAX_DISPLAYS];
+static int      ndisplays         = 0;
 static char     chgnow_id[30]     = "POWER_SUPPLY_ENERGY_NOW";
 static char     pwrnow_id[30]     = "POWER_SUPPLY_POWER_NOW";
-static char     *display_name     = "";
+static char     full_id[30]       = "POWER_SUPPLY_ENERGY_FULL";
 static char     light_color[256]  = "";   /* back-light color */
 static char     *config_file      = NULL; /* name of configfile */
-static unsigned update_interval   = UPDATE_INTERVAL;
+static char     *config_path      = NULL; /* config file actually in use */
+static volatile int reload_config = 0;
+static int      update_interval   = UPDATE_INTERVAL;
+static unsigned idle_interval     = IDLE_INTERVAL; /* 0 disables deep idle */
+static int      deep_idle         = 0;
+static int      power_event       = 0;
 static light    backlight         = LIGHTOFF;
 static unsigned alarm_blink       = ALARM_BLINK;
 static unsigned alarm_level       = ALARM_LEVEL;
 static unsigned alarm_level_temp  = ALARM_TEMP*10;
+static int      critical_level    = CRITICAL_LEVEL;
+static int      blinkspeed        = BLINK_SPEED;
+static unsigned alarm_lights      = 0;    /* ACT_BLINK/ACT_LIGHT of active rules */
+static char     policy_root[256]  = "";   /* prefix for the policy files */
+static int      policy_dry_run    = 0;
+static int      graph_range       = -1;   /* history view on the wheel, -1 if off */
+static int      procs_scan        = PROCS_SCAN;
+static int      proc_view         = -1;   /* consumer shown on middle click, -1 if off */
+static int      proc_phase        = 0;    /* its power instead of its pid */
 static char     *notif_cmd        = NULL;
 static char     *suspend_cmd      = NULL;
+static unsigned cmd_interval      = CMD_INTERVAL; /* min msec between runs */
+static int      direct_exec       = DIRECT_EXEC;
+static char     *socket_path      = NULL; /* query socket, off if NULL */
+static char     *shm_name         = NULL; /* shared memory, off if NULL */
+static char     *metrics_path     = NULL; /* OpenMetrics text file, off if NULL */
+static char     *upower_bus       = NULL; /* batteries from UPower, sysfs if NULL */
+static int      metrics_interval  = METRICS_INTERVAL;
+static char     *stream_format    = NULL; /* status lines on stdout, no X */
+static int      stream_once       = 0;
+static char     *health_log       = NULL; /* battery wear log, off if NULL */
+static char     *energy_log       = NULL; /* energy totals, kept in memory if NULL */
+static int      health_print      = 0;
 static int      mode              = STATMODE;
 static int      togglemode        = TOGGLEMODE;
 static int      togglespeed       = TOGGLESPEED;
 static int      animationspeed    = ANIMATION_SPEED;
-static AcpiInfos cur_acpi_infos;
+static int      animation_off     = 0;    /* stopped by the governor */
+#ifdef CAPS_NUM_UPD_SPD
+static int      lock_poll         = CAPS_NUM_UPD_SPD;
+static int      lock_polling      = 0;    /* some display gets no XKB LED events */
+#endif
+static int      cpu_budget        = CPU_BUDGET;
+static int      wakeup_budget     = WAKEUP_BUDGET;
+static AcpiInfos cur_acpi_infos;  /* what is shown */
+static AcpiInfos sampled;         /* what acpi_read() works on */
+static int      threaded          = 0;
+static unsigned sample_timeout    = SAMPLE_TIMEOUT;
+static int      charging          = 0;
+static int      latency_log       = LATENCY_LOG;
 static int      number_of_batteries = 2;
 static char     uevent_files[2][256] = {BAT0_UEVENT_FILE,BAT1_UEVENT_FILE};
-static char     thermal[256]      = THERMAL_FILE;
+static char     thermal[256]      = "";
+static char     thermal_policy[64] = THERMAL_POLICY;
 static char     ac_state[256]     = AC_STATE_FILE;
 static int      history_size      = RATE_HISTORY;
 static int      blink_pos         = 0;
+static int      thermal_interval  = THERMAL_INTERVAL;
+static int      thermal_wanted    = 1;   /* something looks at the temperature, atomic */
+static int      capacity_interval = CAPACITY_INTERVAL;
+static int      battery_plugged   = 0;
+static int      thermal_changed   = 0;   /* for reconfigure_sources() */
+static int      uevent_changed    = 0;
+static char     bat0_moved[256]   = "";  /* uevent_files[0] before BAT1 took its place */
+
+/*
+ * Every file acpi_read() reads, with the tier that says how often (see
+ * schedule.h). The files are kept open between samples, until their
+ * paths change or a battery comes or goes.
+ */
+typedef struct Source {
+  char        path[256];          /* a copy, the options may change meanwhile */
+  int         tier;
+  unsigned    stale;              /* the STALE_* bit it counts for */
+  int         fd;
+  int         lat;                /* latency histogram */
+  char        *buf;
+  int         size;
+} Source;
+
+enum { ATTR_STATUS, ATTR_POWER, ATTR_ENERGY, ATTRS };
+#define NSOURCES  (1 + 2 * (ATTRS + 1))
+
+static Source   sources[NSOURCES];
+static int      nsources          = 0;
+static int      attr_src[2]       = { -1, -1 };  /* -1 if all comes from uevent */
+static char     attr_files[2][ATTRS][256];
+static char     attr_buf[2][ATTRS][32];
+static char     ac_buf[8];
+static char     uevent_buf[2][MAXSTRLEN];
+
+static int parse_mode(const char *value);
+static int parse_display(const char *value);
+
+/* shared by the config file and the command line */
+static Option options[] = {
+  /* key               long option        short  type        variable            min  max      parse          flags */
+  { NULL,              "--display",       "-d",  OPT_CUSTOM, display_names,      0,   0,       parse_display, 0 },
+  { "backlight",       NULL,              NULL,  OPT_BOOL,   &backlight,         0,   0,       NULL,          0 },
+  { NULL,              "--backlight",     "-bl", OPT_FLAG,   &backlight,         0,   0,       NULL,          0 },
+  { "lightcolor",      "--light-color",   "-lc", OPT_BUFFER, light_color,        0,   256,     NULL,          OPT_LIVE },
+  { "updateinterval",  "--interval",      "-i",  OPT_INT,    &update_interval,   100, INT_MAX, NULL,          OPT_LIVE },
+  { "idle_interval",   NULL,              NULL,  OPT_INT,    &idle_interval,     0,   INT_MAX, NULL,          OPT_LIVE },
+  { "alarm",           "--alarm",         "-a",  OPT_INT,    &alarm_level,       1,   125,     NULL,          OPT_LIVE },
+  { "alarm_blink",     NULL,              NULL,  OPT_BOOL,   &alarm_blink,       0,   0,       NULL,          OPT_LIVE },
+  { "critical",        NULL,              NULL,  OPT_INT,    &critical_level,    0,   125,     NULL,          OPT_LIVE },
+  { "blinkspeed",      NULL,              NULL,  OPT_INT,    &blinkspeed,        100, INT_MAX, NULL,          OPT_LIVE },
+  { "rule",            NULL,              NULL,  OPT_CUSTOM, NULL,               0,   0,       alarm_parse_rule, OPT_LIVE },
+  { "policy",          NULL,              NULL,  OPT_CUSTOM, NULL,               0,   0,       policy_parse_rule, OPT_LIVE },
+  { "policy_root",     "--policy-root",   NULL,  OPT_BUFFER, policy_root,        0,   256,     NULL,          OPT_LIVE },
+  { "policy_dry_run",  NULL,              NULL,  OPT_BOOL,   &policy_dry_run,    0,   0,       NULL,          OPT_LIVE },
+  { NULL,              "--policy-dry-run", NULL, OPT_FLAG,   &policy_dry_run,    0,   0,       NULL,          0 },
+  { NULL,              "--windowed",      "-w",  OPT_FLAG,   &dockapp_iswindowed, 0,  0,       NULL,          0 },
+  { NULL,              "--broken-wm",     "-bw", OPT_FLAG,   &dockapp_isbrokenwm, 0,  0,       NULL,          0 },
+  { "notify",          "--notify",        "-n",  OPT_STRING, &notif_cmd,         0,   0,       NULL,          OPT_LIVE },
+  { "suspend",         "--suspend",       "-s",  OPT_STRING, &suspend_cmd,       0,   0,       NULL,          OPT_LIVE },
+  { "command_interval", NULL,             NULL,  OPT_INT,    &cmd_interval,      0,   INT_MAX, NULL,          OPT_LIVE },
+  { "direct_exec",     NULL,              NULL,  OPT_BOOL,   &direct_exec,       0,   0,       NULL,          OPT_LIVE },
+  { "socket",          "--socket",        "-S",  OPT_STRING, &socket_path,       0,   0,       NULL,          0 },
+  { "shm",             "--shm",           "-M",  OPT_STRING, &shm_name,          0,   0,       NULL,          0 },
+  { "metrics",         "--metrics",       NULL,  OPT_STRING, &metrics_path,      0,   0,       NULL,          0 },
+  { "upower",          "--upower",        NULL,  OPT_STRING, &upower_bus,        0,   0,       NULL,          0 },
+  { "metrics_interval", NULL,             NULL,  OPT_INT,    &metrics_interval,  0,   INT_MAX, NULL,          OPT_LIVE },
+  { "procs",           "--procs",         NULL,  OPT_INT,    &procs_scan,        0,   4096,    NULL,          OPT_LIVE },
+  { NULL,              "--stream",        NULL,  OPT_STRING, &stream_format,     0,   0,       NULL,          0 },
+  { NULL,              "--once",          NULL,  OPT_FLAG,   &stream_once,       0,   0,       NULL,          0 },
+  { "health_log",      "--health-log",    NULL,  OPT_STRING, &health_log,        0,   0,       NULL,          0 },
+  { "energy_log",      "--energy-log",    NULL,  OPT_STRING, &energy_log,        0,   0,       NULL,          0 },
+  { NULL,              "--health-report", NULL,  OPT_FLAG,   &health_print,      0,   0,       NULL,          0 },
+  { "mode",            "--mode",          "-m",  OPT_CUSTOM, &mode,              0,   0,       parse_mode,    OPT_LIVE },
+  { "togglespeed",     "--togglespeed",   "-ts", OPT_INT,    &togglespeed,       100, INT_MAX, NULL,          OPT_LIVE },
+  { "animationspeed",  "--animationspeed", "-as", OPT_INT,   &animationspeed,    100, INT_MAX, NULL,          OPT_LIVE },
+  { "historysize",     "--historysize",   "-hs", OPT_INT,    &history_size,      1,   1000,    NULL,          0 },
+  { "temperature",     NULL,              NULL,  OPT_BUFFER, thermal,            0,   256,     NULL,          OPT_LIVE },
+  { "thermal_policy",  NULL,              NULL,  OPT_BUFFER, thermal_policy,     0,   64,      NULL,          OPT_LIVE },
+  { "bat0_uevent",     NULL,              NULL,  OPT_BUFFER, uevent_files[0],    0,   256,     NULL,          OPT_LIVE },
+  { "bat1_uevent",     NULL,              NULL,  OPT_BUFFER, uevent_files[1],    0,   256,     NULL,          OPT_LIVE },
+  { "ac_state",        NULL,              NULL,  OPT_BUFFER, ac_state,           0,   256,     NULL,          OPT_LIVE },
+  { "sample_timeout",  NULL,              NULL,  OPT_INT,    &sample_timeout,    10,  INT_MAX, NULL,          OPT_LIVE },
+  { "thermal_interval", NULL,             NULL,  OPT_INT,    &thermal_interval,  0,   INT_MAX, NULL,          OPT_LIVE },
+  { "capacity_interval", NULL,            NULL,  OPT_INT,    &capacity_interval, 0,   INT_MAX, NULL,          OPT_LIVE },
+  { "latency_log",     NULL,              NULL,  OPT_INT,    &latency_log,       0,   INT_MAX, NULL,          OPT_LIVE },
+  { "cpu_budget",      NULL,              NULL,  OPT_INT,    &cpu_budget,        0,   INT_MAX, NULL,          OPT_LIVE },
+  { "wakeup_budget",   NULL,              NULL,  OPT_INT,    &wakeup_budget,     0,   INT_MAX, NULL,          OPT_LIVE },
+  { NULL }
+};
+
+/* what the governor may slow down when over budget, see governor.h */
+static Knob knobs[] = {
+  { "update interval",    &update_interval, 60000, NULL,           NULL },
+#if CAPS_NUM_UPD_SPD > 0
+  { "lock LED polling",   &lock_poll,       3200,  NULL,           &lock_polling },
+#endif
+  { "charging animation", &animationspeed,  2000,  &animation_off, &charging },
+  { "toggle speed",       &togglespeed,     16000, NULL,           &togglemode },
+};
 
 #ifdef __linux
 # ifndef ACPI_32_BIT_SUPPORT
@@ -130,6 +284,9 @@ static int      blink_pos         = 0;
 /* prototypes */
 static void parse_config_file(char *config);
 static int update();
+static int use_sample(const AcpiInfos *k, int changed);
+static void alarm_inputs(const AcpiInfos *k, double *in);
+static void sample_ready(const AcpiInfos *k, int changed);
 static void switch_light();
 #ifdef CAPS_NUM_UPD_SPD
 static void draw_locks();
@@ -138,50 +295,79 @@ static void draw_remaining_time(AcpiInfos infos);
 static void draw_batt(AcpiInfos infos);
 static void draw_low();
 static void draw_rate(AcpiInfos infos);
+static void draw_milliwatts(long rate);
 static void draw_temp(AcpiInfos infos);
+static void draw_energy(void);
 static void draw_statusdigit(AcpiInfos infos);
 static void draw_pcgraph(AcpiInfos infos);
+static void draw_graph(void);
+static void draw_proc(void);
+static void redraw_graph(void);
 static void parse_arguments(int argc, char **argv);
 static void print_help(char *prog);
 static int  acpi_exists();
-static int  my_system (char *cmd);
 static void blink_batt();
 static void draw_all();
+static void init_display(char *name, int argc, char **argv);
+static long now_ms(void);
+static int select_display(int n);
+static void redraw();
+static void load_pixmaps(int n);
+static void config_changed(void);
+static void power_changed(int plugged);
+static void rescan_batteries(void);
+static void forget_history(void);
+static void restat_batteries(void);
+static void reconfigure_sources(void);
+static int  resumed(void);
+static int is_idle(const AcpiInfos *k);
+static int toggling(void);
+static void check_thermal_use(void);
+static int  start_thermal(void);
+static void apply_config(void);
+static void watch_dump_signal(void);
+static void stream_loop(void);
 
 #ifdef __linux
 int acpi_read(AcpiInfos *i);
 void init_stats(AcpiInfos *k);
+static void setup_sources(void);
 #endif
 
 
 int main(int argc, char **argv) {
 
   XEvent    event;
-  XpmColorSymbol  colors[2] = { {"Back0", NULL, 0}, {"Back1", NULL, 0} };
-  int       ncolor = 0;
-  static unsigned cns_oldstate;
+  Proc      proc;
   unsigned  cns_state = 0;
-  struct    sigaction sa;
-  long      timeout;
-  int       charging = 0;
-
-  sa.sa_handler = SIG_IGN;
-#ifdef SA_NOCLDWAIT
-  sa.sa_flags = SA_NOCLDWAIT;
-#else
-  sa.sa_flags = 0;
-#endif
-
-  printf("wmbatteries %s  (c) Florian Krohs\n"
-         "<florian.krohs@informatik.uni-oldenburg.de>\n"
-         "This Software comes with absolutely no warranty.\n"
-         "Use at your own risk!\n\n", VERSION);
-
-  sigemptyset(&sa.sa_mask);
-  sigaction(SIGCHLD, &sa, NULL);
+  unsigned  stale;
+  long      timeout, waited;
+  int       streaming = 0;
+  int       got_event;
+  int       n;
+
+  /* in stream mode stdout carries nothing but the status lines */
+  for (n = 1; n < argc; n++)
+    if (!strcmp(argv[n], "--stream") || !strcmp(argv[n], "--once")) streaming = 1;
+  if (streaming)
+    stream_claim_stdout();
+  else
+    printf("wmbatteries %s  (c) Florian Krohs\n"
+           "<florian.krohs@informatik.uni-oldenburg.de>\n"
+           "This Software comes with absolutely no warranty.\n"
+           "Use at your own risk!\n\n", VERSION);
 
   /* Parse CommandLine */
   parse_arguments(argc, argv);
+  alarm_commit(alarm_level, critical_level, alarm_level_temp / 10, alarm_blink);
+  stream_open(stream_format, stream_once);
+  if (health_print) {
+    if (!health_log) {
+      fprintf(stderr, "%s: no health_log configured\n", argv[0]);
+      exit(1);
+    }
+    exit(health_report(health_log));
+  }
 
   /* Check for ACPI support */
   if (!acpi_exists()) {
@@ -194,11 +380,308 @@ int main(int argc, char **argv) {
   }
 
   /* Initialize Application */
-  init_stats(&cur_acpi_infos);
+  latency_configure(latency_log);
+  schedule_interval(TIER_THERMAL, thermal_interval);
+  schedule_interval(TIER_CAPACITY, capacity_interval);
+  init_stats(&sampled);
+  if ((!stream_once || stream_wants_temp()) && start_thermal() == 0)
+    atexit(thermal_close);
+  if (stream_once) {
+    /* a single line for scripts, skip everything that only pays off later */
+    acpi_read(&sampled);
+    stream_emit(&sampled, number_of_batteries);
+    return 0;
+  }
   /*acpi_read(&cur_acpi_infos); */
   /*update(); */
-  dockapp_open_window(display_name, PACKAGE, SIZE, SIZE, argc, argv);
+  if (socket_path && server_open(socket_path) == 0)
+    atexit(server_close);
+  if (shm_name && shmstate_open(shm_name) == 0)
+    atexit(shmstate_close);
+  if (metrics_path && metrics_open(metrics_path, metrics_interval) == 0)
+    atexit(metrics_close);
+  if (health_log && health_open(health_log) == 0)
+    atexit(health_close);
+  energy_open(energy_log);
+  atexit(energy_close);
+  launcher_init();
+  policy_commit(policy_root, policy_dry_run, alarm_level, critical_level, alarm_level_temp / 10);
+  atexit(policy_restore);
+  check_thermal_use();
+  launcher_configure(cmd_interval, direct_exec);
+  governor_configure(cpu_budget, wakeup_budget);
+  governor_knobs(knobs, sizeof(knobs) / sizeof(knobs[0]));
+  procs_configure(procs_scan);
+  watch_dump_signal();
+  if (config_path) options_watch(config_path, config_changed);
+  if (uevent_open(power_changed) == 0)
+    atexit(uevent_close);
+  if (upower_bus && upower_open(upower_bus, power_changed) == 0)
+    atexit(upower_close);
+  if (streaming) stream_loop();
+
+  /* one window per display, all fed by the same sampler */
+  if (ndisplays == 0) display_names[ndisplays++] = "";
+  for (n = 0; n < ndisplays; n++)
+    init_display(display_names[n], argc, argv);
+#if CAPS_NUM_UPD_SPD > 0
+  /* displays with LED events need no polling */
+  for (n = 0; n < ndisplays; n++)
+    if (!canvases[n].xkb_event) lock_polling = 1;
+#endif
+
+  update();
+  for (n = 0; n < ndisplays; n++) {
+    select_display(n);
+    dockapp_show();
+  }
+  /* from here on slow battery reads can't hold up the windows */
+  sampler_configure(sample_timeout);
+  threaded = sampler_start(&sampled, acpi_read, sample_ready) == 0;
+  long update_timeout = update_interval;
+  long animation_timeout = animationspeed;
+  long toggle_timeout = togglespeed;
+  long blink_timeout = blinkspeed;
+  int show = 0;
+  /* Main loop */
+  while (1) {
+    if (resumed()) {
+      /* one sample right away, the other timers start over */
+      update_timeout = 0;
+      animation_timeout = animationspeed;
+      toggle_timeout = togglespeed;
+      blink_timeout = blinkspeed;
+    }
+    if (reload_config) {
+      reload_config = 0;
+      apply_config();
+      /* sample and redraw right away with the new settings */
+      update_timeout = 0;
+      animation_timeout = animationspeed;
+      toggle_timeout = togglespeed;
+      show = 1;
+    }
+    timeout = update_timeout;
+#if CAPS_NUM_UPD_SPD > 0
+    /* in deep idle the LEDs are redrawn on XKB events instead */
+    if (!deep_idle && lock_polling && timeout > lock_poll) timeout = lock_poll;
+#endif
+    if (charging && !animation_off && animation_timeout<timeout) timeout = animation_timeout;
+    if (toggling() && toggle_timeout<timeout) timeout = toggle_timeout;
+    if ((alarm_lights & ACT_BLINK) && blink_timeout<timeout) timeout = blink_timeout;
+
+    waited = now_ms();
+    got_event = dockapp_nextevent_or_timeout(&event, timeout);
+    /* events and wakeups cut the wait short, the timers lose what it took */
+    waited = now_ms() - waited;
+    /* running late is not made up for, no timer goes below zero */
+    if (waited > timeout) waited = timeout;
+    if (got_event) {
+      /* Next Event */
+      switch (event.type) {
+      case ButtonPress:
+        switch (event.xbutton.button) {
+        case 1: switch_light(); break;
+        case 2: /* middle, the next biggest consumer */
+          if (procs_get(proc_view + 1, &proc)) proc_view = -1;
+          else proc_view++, graph_range = -1;
+          proc_phase = 0;
+          toggle_timeout = togglespeed;
+          show = 1;
+          break;
+        case 3: mode=(mode+1)%MODES; toggle_timeout = togglespeed; show=1; check_thermal_use(); break;
+        case 4: /* scroll up, longer history */
+          if (graph_range < GRAPH_RANGES - 1) graph_range++, show = 1;
+          proc_view = -1;
+          break;
+        case 5: /* scroll dn, back to the values */
+          if (graph_range >= 0) graph_range--, show = 1;
+          proc_view = -1;
+          break;
+        default: break;
+        }
+        break;
+      default:
+#ifdef CAPS_NUM_UPD_SPD
+        if (event.type == canvases[dockapp_current()].xkb_event) show = 1;
+#endif
+        break;
+      }
+    }
+    if (power_event) {
+      /* the wait was cut short by a power supply event, sample now */
+      power_event = 0;
+      if (battery_plugged) rescan_batteries();
+      update_timeout = waited;
+    }
+    update_timeout -= waited;
+    if(toggling()) {
+      toggle_timeout -= waited;
+      if(toggle_timeout<5) {
+        toggle_timeout += togglespeed;
+        if (proc_view >= 0) proc_phase = !proc_phase;
+        else mode=(mode+1)%MODES;
+        show = 1;
+      }
+    }
+    if (alarm_lights & ACT_BLINK) {
+      blink_timeout -= waited;
+      if (blink_timeout < 5) {
+        blink_timeout += blinkspeed;
+        switch_light();
+      }
+    } else {
+      blink_timeout = blinkspeed;
+    }
+    if(charging && !animation_off) {
+      animation_timeout -= waited;
+      if(animation_timeout<5) {
+        animation_timeout += animationspeed;
+        if (++blink_pos>=5) blink_pos=0;
+        for (n = 0; n < ndisplays; n++) {
+          if (!select_display(n)) continue;
+          blink_batt();
+          dockapp_copy2window(pixmap);
+        }
+      }
+    }
+    if(update_timeout<5) {
+      if (!threaded) {
+        if (update()) show = 1;
+      } else {
+        /* the result arrives in sample_ready() */
+        sampler_request();
+        if ((stale = sampler_watchdog()) != cur_acpi_infos.stale) {
+          cur_acpi_infos.stale = stale;
+          server_update(&cur_acpi_infos, number_of_batteries);
+        }
+      }
+      update_timeout += deep_idle ? idle_interval : update_interval;
+    }
+    governor_check();
+    for (n = 0; n < ndisplays && !deep_idle; n++) {
+#ifdef CAPS_NUM_UPD_SPD
+      if (canvases[n].xkb_event) continue;
+#endif
+      if (!select_display(n)) continue;
+      XkbGetIndicatorState(display, XkbUseCoreKbd, &cns_state);
+      if(cns_state != canvases[n].cns_state) {
+        canvases[n].cns_state = cns_state;
+        show = 1;
+      }
+    }
+    if(show) {
+      /* show */
+      redraw();
+      show = 0;
+    }
+  }
+  return 0;
+}
+
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+/* open a window on one display and load the pixmaps for it */
+static void init_display(char *name, int argc, char **argv) {
+  dockapp_open_window(name, PACKAGE, SIZE, SIZE, argc, argv);
   dockapp_set_eventmask(ButtonPressMask);
+  load_pixmaps(dockapp_current());
+  graph_open();
+#ifdef CAPS_NUM_UPD_SPD
+  {
+    int opcode, error, major = XkbMajorVersion, minor = XkbMinorVersion;
+    Canvas *c = &canvases[dockapp_current()];
+
+    /* lets deep idle stop polling the LEDs */
+    if (XkbQueryExtension(display, &opcode, &c->xkb_event, &error, &major, &minor) &&
+        !XkbSelectEventDetails(display, XkbUseCoreKbd, XkbIndicatorStateNotify,
+                               XkbAllIndicatorsMask, XkbAllIndicatorsMask))
+      c->xkb_event = 0;
+  }
+#endif
+}
+
+
+/* a battery or the AC adapter changed, don't wait for the next sample */
+static void power_changed(int plugged) {
+  if (plugged) battery_plugged = 1;
+  power_event = 1;
+  dockapp_wakeup();
+}
+
+
+/*
+ * On AC with no battery charging or discharging the display is static,
+ * so the samples get far apart and the toggle and LED polling stop.
+ */
+static int is_idle(const AcpiInfos *k) {
+  int bat;
+
+  if (!idle_interval || k->ac_line_status != 1 || k->low ||
+      k->thermal_temp > alarm_level_temp) return 0;
+  for (bat = 0; bat < number_of_batteries; bat++)
+    if (k->battery_status[bat] == CHARGING || k->battery_status[bat] == DISCHARGING)
+      return 0;
+  return 1;
+}
+
+
+/*
+ * The temperature is only read while the lower row, a stream field, an
+ * alarm or policy rule or one of the exports can show it.
+ */
+static void check_thermal_use(void) {
+  int want;
+
+  want = stream_format ? stream_wants_temp() : mode == TEMP || togglemode;
+  want = want || alarm_uses(IN_TEMP) || policy_uses_temp() ||
+         socket_path || shm_name || metrics_path;
+  if (want == __atomic_load_n(&thermal_wanted, __ATOMIC_RELAXED)) return;
+  DPRINTF("D: %s reading the temperature\n", want ? "resuming" : "stopped")
+  if (want) schedule_force(TIER(TIER_THERMAL));
+  __atomic_store_n(&thermal_wanted, want, __ATOMIC_RELAXED);
+}
+
+
+/* a temperature file given without a thermal_policy is what gets read */
+static int start_thermal(void) {
+  const char *file = thermal[0] ? thermal : THERMAL_FILE;
+
+  if (thermal_policy[0]) return thermal_init(thermal_policy, file);
+  return thermal_init(thermal[0] ? "file" : "max", file);
+}
+
+
+/* the lower row alternates in toggle mode and in the process view */
+static int toggling(void) {
+  return proc_view >= 0 || (togglemode && !deep_idle && graph_range < 0);
+}
+
+
+static unsigned long pixel_at(Pixmap p, int x, int y) {
+  XImage        *img = XGetImage(display, p, x, y, 1, 1, AllPlanes, ZPixmap);
+  unsigned long pixel = 0;
+
+  if (img) {
+    pixel = XGetPixel(img, 0, 0);
+    XDestroyImage(img);
+  }
+  return pixel;
+}
+
+
+/* (re)create the pixmaps of display n in the current light colour */
+static void load_pixmaps(int n) {
+  DockappColorSymbol colors[2] = { {"Back0", 0}, {"Back1", 0} };
+  int       ncolor = 0;
+  Canvas    *c = &canvases[n];
 
   if (strcmp(light_color,"")) {
     colors[0].pixel = dockapp_getcolor(light_color);
@@ -206,29 +689,31 @@ int main(int argc, char **argv) {
     ncolor = 2;
   }
 
-  /* change raw xpm data to pixmap */
-  if (dockapp_iswindowed)
-    backlight_on_xpm[1] = backlight_off_xpm[1] = WINDOWED_BG;
-
-  if (!dockapp_xpm2pixmap(backlight_on_xpm, &backdrop_on, &mask, colors, ncolor)) {
+  if (!dockapp_image2pixmap(&backlight_on_img, &c->backdrop_on, &mask, colors, ncolor)) {
     fprintf(stderr, "Error initializing backlit background image.\n");
     exit(1);
   }
-  if (!dockapp_xpm2pixmap(backlight_off_xpm, &backdrop_off, NULL, NULL, 0)) {
+  if (!dockapp_image2pixmap(&backlight_off_img, &c->backdrop_off, NULL, NULL, 0)) {
     fprintf(stderr, "Error initializing background image.\n");
     exit(1);
   }
-  if (!dockapp_xpm2pixmap(parts_xpm, &parts, NULL, colors, ncolor)) {
+  if (!dockapp_image2pixmap(&parts_img, &c->parts, NULL, colors, ncolor)) {
     fprintf(stderr, "Error initializing parts image.\n");
     exit(1);
   }
 
+  /* the graph is drawn in the colours of the LCD */
+  c->lcd_off = pixel_at(c->backdrop_off, 5, 45);
+  c->lcd_on = pixel_at(c->backdrop_on, 5, 45);
+  c->lcd_ink = pixel_at(c->parts, 0, 58);
+
   /* shape window */
   if (!dockapp_iswindowed) dockapp_setshape(mask, 0, 0);
   if (mask) XFreePixmap(display, mask);
 
   /* pixmap : draw area */
-  pixmap = dockapp_XCreatePixmap(SIZE, SIZE);
+  if (!c->pixmap) c->pixmap = dockapp_XCreatePixmap(SIZE, SIZE);
+  select_display(n);
 
   /* Initialize pixmap */
   if (backlight == LIGHTON)
@@ -237,82 +722,36 @@ int main(int argc, char **argv) {
     dockapp_copyarea(backdrop_off, pixmap, 0, 0, SIZE, SIZE, 0, 0);
 
   dockapp_set_background(pixmap);
-  update();
-  dockapp_show();
-  long update_timeout = update_interval;
-  long animation_timeout = animationspeed;
-  long toggle_timeout = togglespeed;
-  int show = 0;
-  /* Main loop */
-  while (1) {
-#if CAPS_NUM_UPD_SPD > 0
-    timeout = CAPS_NUM_UPD_SPD;
-    if (update_timeout<timeout)
-#endif
-      timeout = update_timeout;
-    if (charging && animation_timeout<timeout) timeout = animation_timeout;
-    if (togglemode && toggle_timeout<timeout)  timeout = toggle_timeout;
+}
 
-    if (dockapp_nextevent_or_timeout(&event, timeout)) {
-      /* Next Event */
-      switch (event.type) {
-      case ButtonPress:
-        switch (event.xbutton.button) {
-        case 1: switch_light(); break;
-        case 3: mode=!mode; toggle_timeout = togglespeed; show=1; break;
-        case 4: /* scroll up */ break;
-        case 5: /* scroll dn */ break;
-        default: break;
-        }
-        break;
-      default: break;
-      }
-    } else {
-      /* Time Out */
-      update_timeout -= timeout;
-      if(togglemode) {
-        toggle_timeout -= timeout;
-        if(toggle_timeout<5) {
-          toggle_timeout += togglespeed;
-          mode=!mode;
-          show = 1;
-        }
-      }
-      if(charging) {
-        animation_timeout -= timeout;
-        if(animation_timeout<5) {
-          animation_timeout += animationspeed;
-          blink_batt();
-          dockapp_copy2window(pixmap);
-        }
-      }
-      if(update_timeout<5) {
-        update_timeout += update_interval;
-        if (update()) show = 1;
-        if (cur_acpi_infos.battery_status[0]==CHARGING || cur_acpi_infos.battery_status[1]==CHARGING)
-          charging = 1;
-        else
-          charging = 0;
-      }
-      XkbGetIndicatorState(display, XkbUseCoreKbd, &cns_state);
-      if(cns_state != cns_oldstate) {
-        cns_oldstate = cns_state;
-        show = 1;
-      }
-      if(show) {
-        /* show */
-        draw_all();
-        dockapp_copy2window(pixmap);
-        show = 0;
-      }
-    }
+
+/* make display n and its pixmaps the target of the draw_* functions,
+   0 if its window has been closed */
+static int select_display(int n) {
+  if (!dockapp_select(n)) return 0;
+  pixmap = canvases[n].pixmap;
+  backdrop_on = canvases[n].backdrop_on;
+  backdrop_off = canvases[n].backdrop_off;
+  parts = canvases[n].parts;
+  return 1;
+}
+
+
+/* repaint every display */
+static void redraw() {
+  int n;
+
+  for (n = 0; n < ndisplays; n++) {
+    if (!select_display(n)) continue;
+    draw_all();
+    dockapp_copy2window(pixmap);
   }
-  return 0;
 }
 
 
 void init_stats(AcpiInfos *k) {
   int bat_status[2]={NONE,NONE};
+  struct timespec start, end;
   FILE *fd;
   char *buf;
   char *ptr;
@@ -322,12 +761,17 @@ void init_stats(AcpiInfos *k) {
   buf=(char *)malloc(sizeof(char)*MAXSTRLEN);
   if(buf == NULL)
     exit(-1);
+  /* undo an earlier move of BAT1 into the first slot, unless reconfigured */
+  if (bat0_moved[0] && !strcmp(uevent_files[0], uevent_files[1]))
+    strcpy(uevent_files[0], bat0_moved);
+  bat0_moved[0] = '\0';
   /* get info about existing batteries */
   number_of_batteries=0;
   for(i=0; i<2; i++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
     if((fd = fopen(uevent_files[i], "r"))) {
       bzero(buf, MAXSTRLEN);
-      if (fread(buf, 1, MAXSTRLEN, fd)) {
+      if (fread(buf, 1, MAXSTRLEN - 1, fd)) {
         if ((ptr = strstr(buf,"POWER_SUPPLY_PRESENT="))) {
           if(ptr[21] == '1') {
             bat_status[i] = BAT_OK;
@@ -343,6 +787,7 @@ void init_stats(AcpiInfos *k) {
             sscanf(ptr+24, "%ld", &tmp);
           } else if ((ptr = strstr(buf,"POWER_SUPPLY_CHARGE_NOW="))) {
             strcpy(chgnow_id, "POWER_SUPPLY_CHARGE_NOW");
+            strcpy(full_id, "POWER_SUPPLY_CHARGE_FULL");
             sscanf(ptr+24, "%ld", &tmp);
           } else {
             DPRINTF("POWER_SUPPLY_ENERGY_NOW not found in '%s'\n", uevent_files[i])
@@ -353,6 +798,7 @@ void init_stats(AcpiInfos *k) {
             if ((ptr = strstr(buf,"POWER_SUPPLY_ENERGY_FULL_DESIGN=")) \
              || (ptr = strstr(buf,"POWER_SUPPLY_CHARGE_FULL_DESIGN="))) {
               sscanf(ptr+32, "%ld", &tmp);
+              k->design[i] = tmp;
               printf("BAT%d OK, %0.1f%% performance\n", i, (float)k->currcap[i] * 100.0f / (float)tmp);
             } else {
               DPRINTF("POWER_SUPPLY_ENERGY_FULL_DESIGN not found in '%s'\n", uevent_files[i])
@@ -372,6 +818,9 @@ void init_stats(AcpiInfos *k) {
         }
       }
       fclose(fd);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      latency_add(latency_source(uevent_files[i]), (end.tv_sec - start.tv_sec) * 1000000 +
+                                                   (end.tv_nsec - start.tv_nsec) / 1000);
     } else {
       DPRINTF("D: File not found: '%s'\n", uevent_files[i])
     }
@@ -379,8 +828,10 @@ void init_stats(AcpiInfos *k) {
   free(buf);
 
   if(bat_status[0]!=BAT_OK && bat_status[1]==BAT_OK) {
+    strcpy(bat0_moved, uevent_files[0]);
     strcpy(uevent_files[0], uevent_files[1]);
     k->currcap[0] = k->currcap[1];
+    k->design[0] = k->design[1];
     k->rate[0] = k->rate[1];
   }
 
@@ -389,10 +840,10 @@ void init_stats(AcpiInfos *k) {
   /* initialising history buffer */
   if ((k->ratehist[0] = (long*)malloc(history_size * sizeof(long))) == NULL) exit(-1);
   for (i=0; i<history_size; i++) k->ratehist[0][i] = k->rate[0];
-  if (number_of_batteries == 2) {
-    if ((k->ratehist[1] = (long*)malloc(history_size * sizeof(long))) == NULL) exit(-1);
-    for (i=0; i<history_size; i++) k->ratehist[1][i] = k->rate[1];
-  } else k->ratehist[1] = NULL;
+  /* UPower may know of a second battery that sysfs did not show */
+  if ((k->ratehist[1] = (long*)malloc(history_size * sizeof(long))) == NULL) exit(-1);
+  for (i=0; i<history_size; i++) k->ratehist[1][i] = k->rate[1];
+  k->power[0] = k->power[1] = 0;
   k->ac_line_status = 0;
   k->battery_status[0] = 0;
   k->battery_percentage[0] = 0;
@@ -402,211 +853,364 @@ void init_stats(AcpiInfos *k) {
   k->remain[1] = 0;
   k->thermal_temp = 0;
   k->thermal_state = 0;
+  setup_sources();
 }
 
 
-/* called by timer */
+/* called by timer when there is no sampler thread */
 static int update() {
-  static light pre_backlight;
-  static Bool in_alarm_mode = False, suspended = False;
-  int ret;
+  return use_sample(&sampled, acpi_read(&sampled));
+}
 
-  /* get current battery usage in percent */
-  ret = acpi_read(&cur_acpi_infos);
 
-  /* alarm mode */
-  if (cur_acpi_infos.low || (cur_acpi_infos.thermal_temp > alarm_level_temp)) {
-    if (!in_alarm_mode) {
-      pre_backlight = backlight;
-      my_system(notif_cmd);
-    }
-    if (!suspended && ((cur_acpi_infos.low>1) || (cur_acpi_infos.thermal_temp > alarm_level_temp+5))) {
-      suspended = True;
-      my_system(suspend_cmd);
-    }
-    if (alarm_blink || !in_alarm_mode) {
-      switch_light();
-      in_alarm_mode = True;
-      return 0;
-    }
-  } else {
-    if (in_alarm_mode) {
-      suspended = False;
-      in_alarm_mode = False;
-      if (backlight != pre_backlight) {
-        switch_light();
-        return 0;
-      }
-    }
+/* a sample from the sampler thread */
+static void sample_ready(const AcpiInfos *k, int changed) {
+  if (use_sample(k, changed)) redraw();
+}
+
+
+/* what the alarm rules look at */
+static void alarm_inputs(const AcpiInfos *k, double *in) {
+  long  remain = 0, capacity = 0;
+  int   bat;
+
+  for (bat = 0; bat < number_of_batteries; bat++) {
+    remain += k->remain[bat];
+    capacity += k->currcap[bat];
+  }
+  in[IN_TOTAL] = capacity > 0 ? remain * 100.0 / capacity : NAN;
+  in[IN_BAT0] = number_of_batteries > 0 ? k->battery_percentage[0] : NAN;
+  in[IN_BAT1] = number_of_batteries > 1 ? k->battery_percentage[1] : NAN;
+  in[IN_TEMP] = k->thermal_temp / 10.0;
+  in[IN_RATE] = (k->rate[0] + k->rate[1]) / 1000000.0;
+  in[IN_TIME] = k->battery_status[0] == DISCHARGING || k->battery_status[1] == DISCHARGING ?
+                k->hours_left * 60 + k->minutes_left : NAN;
+}
+
+
+/* what the window shows of a sample, at the resolution it is drawn in */
+typedef struct View {
+  int   hours, minutes;       /* -1 for the 00:00 on AC */
+  int   ac, low, nbat;
+  int   charging[2];
+  int   percent[2];
+  int   row_mode;             /* -1 while the graph or a process is shown */
+  long  row;
+} View;
+
+static View shown;
+
+
+/* returns 1 if a redraw would change any pixel of the sample's parts */
+static int view_changed(const AcpiInfos *k) {
+  View  v;
+  int   bat;
+
+  memset(&v, 0, sizeof(v));
+  v.ac = k->ac_line_status == 1;
+  v.hours = v.ac && !charging ? -1 : k->hours_left;
+  v.minutes = v.ac && !charging ? -1 : k->minutes_left;
+  v.low = k->low;
+  v.nbat = number_of_batteries;
+  for (bat = 0; bat < number_of_batteries && bat < 2; bat++) {
+    v.charging[bat] = k->battery_status[bat] == CHARGING;
+    v.percent[bat] = k->battery_percentage[bat];
+  }
+  /* those two redraw themselves */
+  v.row_mode = proc_view >= 0 || graph_range >= 0 ? -1 : mode;
+  if (v.row_mode == RATE) v.row = (k->rate[0] + k->rate[1]) / 1000;
+  else if (v.row_mode == TEMP) v.row = k->thermal_temp;
+  else if (v.row_mode == ENERGY) v.row = energy_get(ENERGY_DAY, 0) / 100000;
+  if (!memcmp(&v, &shown, sizeof(v))) return 0;
+  shown = v;
+  return 1;
+}
+
+
+/* takes over a finished sample, returns 1 if the windows need a redraw */
+static int use_sample(const AcpiInfos *k, int changed) {
+  static light pre_backlight;
+  double    in[INPUTS];
+  unsigned  lights;
+  unsigned  moved;
+  int       ret;
+
+  memcpy(&cur_acpi_infos, k, sizeof(AcpiInfos));
+  charging = cur_acpi_infos.battery_status[0]==CHARGING || cur_acpi_infos.battery_status[1]==CHARGING;
+  if (is_idle(&cur_acpi_infos) != deep_idle) {
+    deep_idle = !deep_idle;
+    DPRINTF("D: %s deep idle\n", deep_idle ? "entering" : "leaving")
+  }
+
+  /* clients get every change, the windows only what they show */
+  if (changed) server_update(&cur_acpi_infos, number_of_batteries);
+  shmstate_update(&cur_acpi_infos, number_of_batteries);
+  metrics_update(&cur_acpi_infos, number_of_batteries, cur_acpi_infos.amps);
+
+  /* alarm rules, the blinking itself runs on a timer in the main loop */
+  alarm_inputs(&cur_acpi_infos, in);
+  moved = graph_add(cur_acpi_infos.rate[0] + cur_acpi_infos.rate[1],
+                    isnan(in[IN_TOTAL]) ? -1 : in[IN_TOTAL]);
+  energy_update(&cur_acpi_infos, number_of_batteries, cur_acpi_infos.amps);
+  ret = view_changed(&cur_acpi_infos);
+  if (procs_update(cur_acpi_infos.rate[0] + cur_acpi_infos.rate[1]) && proc_view >= 0) ret = 1;
+  lights = alarm_update(in, notif_cmd, suspend_cmd);
+  policy_update(cur_acpi_infos.ac_line_status == 1, in);
+  if (lights != alarm_lights) {
+    if (!alarm_lights) pre_backlight = backlight;
+    if ((lights & ACT_BLINK) && !(alarm_lights & ACT_BLINK))
+      backlight = pre_backlight == LIGHTON ? LIGHTOFF : LIGHTON;
+    else if (lights & ACT_LIGHT)
+      backlight = LIGHTON;
+    else if (!lights)
+      backlight = pre_backlight;
+    alarm_lights = lights;
+    ret = 1;
   }
+  /* a full redraw follows anyway if anything else changed */
+  if (!ret && graph_range >= 0 && (moved & (1u << graph_range))) redraw_graph();
   return ret;
 }
 
 
 static void parse_config_file(char *config) {
+  static char buf[MAXSTRLEN];
+  char *home;
 
-  FILE *fd=NULL;
-  char *buf;
-  char *item;
-  char *value;
-  extern int errno;
-  int linenr=0;
-  int tmp;
-  buf=(char *)malloc(sizeof(char)*MAXSTRLEN);
-  if(buf == NULL)
-    exit(-1);
   if(config != NULL) {
-    if((fd = fopen(config, "r"))) {
+    if(options_parse_file(options, config, 0) >= 0) {
       DPRINTF("D: using command line given config file '%s'\n", config)
-    } else {
-      printf("Config file '%s' NOT found\n", config);
+      config_path = config;
+      return;
     }
+    printf("Config file '%s' NOT found\n", config);
   }
-  if(fd==NULL) {
-    strcpy(buf, getenv("HOME"));
+  if((home = getenv("HOME")) && strlen(home) + 16 < MAXSTRLEN) {
+    strcpy(buf, home);
     strcat(buf, "/.wmbatteriesrc");
-    if((fd = fopen(buf, "r"))) {
+    if(options_parse_file(options, buf, 0) >= 0) {
       DPRINTF("D: using config file '%s'\n", buf)
-    } else {
-      if((fd = fopen("/etc/wmbatteries", "r"))) {
-        DPRINTF("D: using config file '/etc/wmbatteries'\n")
-      } else {
-        DPRINTF("D: no config file found. Using defaults\n")
-      }
+      config_path = buf;
+      return;
     }
   }
+  if(options_parse_file(options, "/etc/wmbatteries", 0) >= 0) {
+    DPRINTF("D: using config file '/etc/wmbatteries'\n")
+    config_path = "/etc/wmbatteries";
+    return;
+  }
+  DPRINTF("D: no config file found. Using defaults\n")
+}
 
-  if(fd!=NULL) { /* some config file was found, try parsing */
-    while( fgets( buf, 255, fd ) != NULL ) {
 
-      item = strtok( buf, "\t =\n\r" ) ;
-      if( item != NULL && item[0] != '#' ) {
-        value = strtok( NULL, "\t =\n\r" );
-        if(!strcmp(item,"backlight")) {
-          if(strcasecmp(value,"yes") && strcasecmp(value,"true") && strcasecmp(value,"false") && strcasecmp(value,"no")) {
-            printf("backlight option wrong in line %i,use yes/no or true/false\n",linenr);
-          } else {
-            if(!strcasecmp(value,"true") || !strcasecmp(value,"yes")) {
-              backlight = LIGHTON;
-            } else {
-              backlight = LIGHTOFF;
-            }
-          }
-        }
+/* accepts both the config file (rate/temp/toggle) and option (r/t/s) forms */
+static int parse_mode(const char *value) {
+  int old_mode = mode, old_toggle = togglemode;
+
+  if(!strcmp(value,"rate") || !strcmp(value,"r")) {
+    togglemode=0;
+    mode=RATE;
+  } else if(!strcmp(value,"temp") || !strcmp(value,"t")) {
+    togglemode=0;
+    mode=TEMP;
+  } else if(!strcmp(value,"energy") || !strcmp(value,"e")) {
+    togglemode=0;
+    mode=ENERGY;
+  } else if(!strcmp(value,"toggle") || !strcmp(value,"s")) {
+    togglemode=1;
+  } else {
+    return -1;
+  }
+  return mode != old_mode || togglemode != old_toggle;
+}
 
-        if(!strcmp(item,"alarm_blink")) {
-          if(strcasecmp(value,"yes") && strcasecmp(value,"true") && strcasecmp(value,"false") && strcasecmp(value,"no")) {
-            printf("alarm_blink option wrong in line %i,use yes/no or true/false\n",linenr);
-          } else {
-            if(!strcasecmp(value,"true") || !strcasecmp(value,"yes")) {
-              alarm_blink = True;
-            } else {
-              alarm_blink = False;
-            }
-          }
-        }
 
-        if(!strcmp(item,"notify")) {
-          if (!((notif_cmd = (char*)malloc(256)))) exit(-1);
-          strcpy(notif_cmd,value);
-          while ((value = strtok( NULL, "\t \n\r" )))
-          {
-            strcat(notif_cmd, " ");
-            strcat(notif_cmd, value);
-          }
-        }
+/* may be repeated, or given a comma separated list */
+static int parse_display(const char *value) {
+  char *list, *ptr;
 
-        if(!strcmp(item,"suspend")) {
-          if (!((suspend_cmd = (char*)malloc(256)))) exit(-1);
-          strcpy(suspend_cmd,value);
-          while ((value = strtok( NULL, "\t \n\r" )))
-          {
-            strcat(suspend_cmd, " ");
-            strcat(suspend_cmd, value);
-          }
-        }
+  if (!((list = strdup(value)))) exit(-1);
+  for (ptr = strtok(list, ","); ptr; ptr = strtok(NULL, ",")) {
+    if (ndisplays == DOCKAPP_MAX_DISPLAYS) {
+      fprintf(stderr, "at most %d displays are supported\n", DOCKAPP_MAX_DISPLAYS);
+      return -1;
+    }
+    display_names[ndisplays++] = ptr;
+  }
+  return 1;
+}
 
-        if(!strcmp(item,"lightcolor")) {
-          strcpy(light_color,value);
-        }
 
-        if(!strcmp(item,"temperature")) {
-          strcpy(thermal,value);
-        }
+/* inotify callback, runs inside dockapp_nextevent_or_timeout() */
+static void config_changed(void) {
+  reload_config = 1;
+  dockapp_wakeup();
+}
 
-        if(!strcmp(item,"bat0_uevent")) {
-          strcpy(uevent_files[0],value);
-        }
 
-        if(!strcmp(item,"bat1_uevent")) {
-          strcpy(uevent_files[1],value);
-        }
+/* --stream: sample, check alarms and print, without opening any window */
+static void stream_loop(void) {
+  XEvent  event;
 
-        if(!strcmp(item,"ac_state")) {
-          strcpy(ac_state,value);
-        }
+  for (;;) {
+    if (reload_config) {
+      reload_config = 0;
+      apply_config();
+    }
+    if (battery_plugged) rescan_batteries();
+    resumed();
+    power_event = 0;
+    update();
+    stream_emit(&cur_acpi_infos, number_of_batteries);
+    deep_idle = is_idle(&cur_acpi_infos);
+    /* without displays this only returns on timeouts and wakeups */
+    dockapp_nextevent_or_timeout(&event, deep_idle ? idle_interval : update_interval);
+  }
+}
 
-        if(!strcmp(item,"updateinterval")) {
-          tmp=atoi(value);
-          if(tmp<100) {
-            printf("update interval is out of range in line %i,must be >= 100\n",linenr);
-          } else {
-            update_interval=tmp;
-          }
-        }
 
-        if(!strcmp(item,"alarm")) {
-          tmp=atoi(value);
-          if(tmp<1 || tmp>125) {
-            printf("alarm is out of range in line %i,must be > 0 and <= 125\n",linenr);
-          } else {
-            alarm_level=tmp;
-          }
-        }
+/*
+ * After a suspend the rate history is from another time and the slow
+ * tiers may have changed, so the next sample starts afresh. Returns 1
+ * the first time it is called after a resume.
+ */
+static int resumed(void) {
+  long  slept;
 
-        if(!strcmp(item,"togglespeed")) {
-          tmp=atoi(value);
-          if(tmp<100) {
-            printf("togglespeed variable is out of range in line %i,must be >= 100\n",linenr);
-          } else {
-            togglespeed=tmp;
-          }
-        }
+  if (!(slept = schedule_suspended())) return 0;
+  DPRINTF("D: resumed after %ld sec of suspend\n", slept / 1000)
+  sampler_post(forget_history);
+  return 1;
+}
 
-        if(!strcmp(item,"animationspeed")) {
-          tmp=atoi(value);
-          if(tmp<100) {
-            printf("animationspeed variable is out of range in line %i,must be >= 100\n",linenr);
-          } else {
-            animationspeed=tmp;
-          }
-        }
 
-        if(!strcmp(item,"historysize")) {
-          tmp=atoi(value);
-          if(tmp<1 || tmp>1000) {
-            printf("historysize variable is out of range in line %i,must be >=1 and <=1000\n",linenr);
-          } else {
-            history_size=tmp;
-          }
-        }
+/* sampler jobs, these run between two acpi_read() calls */
+static void forget_history(void) {
+  int i;
 
-        if(!strcmp(item,"mode")) {
-          if(strcmp(value,"rate") && strcmp(value,"toggle") && strcmp(value,"temp")) {
-            printf("mode must be one of rate,temp,toggle in line %i\n",linenr);
-          } else {
-            togglemode=0;
-            if(!strcmp(value,"rate")) mode=RATE;
-            if(!strcmp(value,"temp")) mode=TEMP;
-            if(!strcmp(value,"toggle")) togglemode=1;
-          }
-        }
-      }
-      linenr++;
+  /* empty slots count as the newest rate, see acpi_read() */
+  for (i = 0; i < history_size; i++) {
+    sampled.ratehist[0][i] = 0;
+    sampled.ratehist[1][i] = 0;
+  }
+  schedule_force(~0u);
+}
+
+
+static void restat_batteries(void) {
+  UPowerState up;
+
+  free(sampled.ratehist[0]);
+  free(sampled.ratehist[1]);
+  init_stats(&sampled);
+  if (upower_get(&up) == 0) number_of_batteries = up.nbat;
+}
+
+
+/* the part of a config reload that acpi_read() depends on */
+static void reconfigure_sources(void) {
+  latency_configure(latency_log);
+  if (thermal_changed) {
+    start_thermal();
+    schedule_force(TIER(TIER_THERMAL));
+  }
+  schedule_interval(TIER_THERMAL, thermal_interval);
+  schedule_interval(TIER_CAPACITY, capacity_interval);
+  if (uevent_changed) restat_batteries();
+  else setup_sources();
+}
+
+
+/* a battery came or went, the static values have to be read again */
+static void rescan_batteries(void) {
+  battery_plugged = 0;
+  sampler_post(restat_batteries);
+}
+
+
+/*
+ * kill -USR1 prints what wmbatteries knows about itself, SIGTERM and
+ * SIGINT exit through atexit() so the power policy is rolled back.
+ */
+static void dump_stats(int fd, void *data) {
+#ifdef __linux
+  struct signalfd_siginfo si;
+
+  while (read(fd, &si, sizeof(si)) == sizeof(si))
+    if (si.ssi_signo != SIGUSR1) exit(0);
+#endif
+  latency_print(stdout);
+  governor_print(stdout);
+  procs_print(stdout);
+  energy_print(stdout);
+}
+
+
+static void watch_dump_signal(void) {
+#ifdef __linux
+  sigset_t mask;
+  int fd;
+
+  /* before the sampler thread starts, so it inherits the blocked signal */
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGINT);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+  if ((fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) >= 0 &&
+      dockapp_watch_fd(fd, dump_stats, NULL))
+    return;
+  if (fd >= 0) close(fd);
+  sigprocmask(SIG_UNBLOCK, &mask, NULL);
+#endif
+}
+
+
+/* re-read the live options of the config file and apply what changed */
+static void apply_config(void) {
+  char  old_color[256];
+  char  old_uevent[2][256];
+  char  old_thermal[256];
+  char  old_policy[64];
+  int   n;
+
+  /* a job still reading the old paths would see them change underneath */
+  if (sampler_busy()) {
+    reload_config = 1;
+    return;
+  }
+  strcpy(old_color, light_color);
+  strcpy(old_thermal, thermal);
+  strcpy(old_policy, thermal_policy);
+  memcpy(old_uevent, uevent_files, sizeof(old_uevent));
+  alarm_begin();
+  policy_begin();
+  if ((n = options_parse_file(options, config_path, 1)) >= 0) {
+    n += alarm_commit(alarm_level, critical_level, alarm_level_temp / 10, alarm_blink);
+    n += policy_commit(policy_root, policy_dry_run, alarm_level, critical_level, alarm_level_temp / 10);
+  }
+  if (n <= 0) return;
+  printf("Config file '%s' reloaded\n", config_path);
+
+  launcher_configure(cmd_interval, direct_exec);
+  governor_configure(cpu_budget, wakeup_budget);
+  metrics_configure(metrics_interval);
+  check_thermal_use();
+  procs_configure(procs_scan);
+  if (!procs_scan) proc_view = -1;
+  sampler_configure(sample_timeout);
+  thermal_changed = strcmp(old_thermal, thermal) || strcmp(old_policy, thermal_policy);
+  uevent_changed = memcmp(old_uevent, uevent_files, sizeof(old_uevent)) != 0;
+  sampler_post(reconfigure_sources);
+  if (strcmp(old_color, light_color)) {
+    for (n = 0; n < ndisplays; n++) {
+      if (!select_display(n)) continue;
+      XFreePixmap(display, canvases[n].backdrop_on);
+      XFreePixmap(display, canvases[n].backdrop_off);
+      XFreePixmap(display, canvases[n].parts);
+      load_pixmaps(n);
     }
-    fclose(fd);
   }
-  free(buf);
 }
 
 
@@ -640,8 +1244,11 @@ static void draw_all() {
 #ifdef CAPS_NUM_UPD_SPD
   draw_locks();
 #endif
-  if(mode==RATE) draw_rate(cur_acpi_infos);
+  if(proc_view >= 0) draw_proc();
+  else if(graph_range >= 0) draw_graph();
+  else if(mode==RATE) draw_rate(cur_acpi_infos);
   else if(mode==TEMP) draw_temp(cur_acpi_infos);
+  else if(mode==ENERGY) draw_energy();
   draw_statusdigit(cur_acpi_infos);
   draw_pcgraph(cur_acpi_infos);
 
@@ -656,30 +1263,14 @@ static void switch_light() {
   switch (backlight) {
   case LIGHTOFF:
     backlight = LIGHTON;
-    dockapp_copyarea(backdrop_on, pixmap, 0, 0, 58, 58, 0, 0);
     break;
   case LIGHTON:
     backlight = LIGHTOFF;
-    dockapp_copyarea(backdrop_off, pixmap, 0, 0, 58, 58, 0, 0);
     break;
   }
 
-  draw_remaining_time(cur_acpi_infos);
-#ifdef CAPS_NUM_UPD_SPD
-  draw_locks();
-#endif
-  if(mode==RATE) draw_rate(cur_acpi_infos);
-  else if(mode==TEMP) draw_temp(cur_acpi_infos);
-  draw_statusdigit(cur_acpi_infos);
-  draw_pcgraph(cur_acpi_infos);
-  if(cur_acpi_infos.battery_status[0]==CHARGING || cur_acpi_infos.battery_status[1]==CHARGING) {
-    blink_batt();
-  } else draw_batt(cur_acpi_infos);
-  if(cur_acpi_infos.low) {
-    draw_low();
-  }
   /* show */
-  dockapp_copy2window(pixmap);
+  redraw();
 }
 
 
@@ -689,7 +1280,6 @@ static void blink_batt() {
   if (backlight == LIGHTON) {
     light_offset=50;
   }
-  if (++blink_pos>=5) blink_pos=0;
   for(bat=0;bat<number_of_batteries;bat++) {
     if(cur_acpi_infos.battery_status[bat]==CHARGING) {
       dockapp_copyarea(parts, pixmap, blink_pos*9+light_offset , 117, 9, 5,  16+bat*11, 39);
@@ -731,6 +1321,45 @@ static void draw_remaining_time(AcpiInfos infos) {
 }
 
 
+/* the history replaces the rate/temperature row */
+static void draw_graph(void) {
+  Canvas *c = &canvases[dockapp_current()];
+
+  graph_draw(pixmap, graph_range, 5, 46, backlight == LIGHTON ? c->lcd_on : c->lcd_off, c->lcd_ink);
+}
+
+
+/* the consumer picked by middle clicks, its pid and its power in turn */
+static void draw_proc(void) {
+  Proc  p;
+  int   x, light_offset = 0;
+
+  if (procs_get(proc_view, &p) < 0) {
+    draw_rate(cur_acpi_infos);
+    return;
+  }
+  if (proc_phase) {
+    draw_milliwatts(p.mw);
+    return;
+  }
+  if (backlight == LIGHTON) light_offset = 50;
+  for (x = 42; x >= 5 && (p.pid || x == 42); x -= 6, p.pid /= 10)
+    dockapp_copyarea(parts, pixmap, (p.pid % 10)*5 + light_offset, 40, 5, 9, x, 46);
+}
+
+
+/* a sample only moved the graph */
+static void redraw_graph(void) {
+  int n;
+
+  for (n = 0; n < ndisplays; n++) {
+    if (!select_display(n)) continue;
+    draw_graph();
+    dockapp_copy2window(pixmap);
+  }
+}
+
+
 static void draw_low() {
   int y = 0;
   if (backlight == LIGHTON) y = 28;
@@ -758,6 +1387,28 @@ static void draw_temp(AcpiInfos infos) {
 }
 
 
+/* today's energy used, like the temperature with Wh for the unit */
+static void draw_energy(void) {
+  long wh = energy_get(ENERGY_DAY, 0) / 100000;
+  int light_offset=0;
+  if (backlight == LIGHTON) {
+    light_offset=50;
+  }
+
+  if (wh > 9999) wh = 9999;
+  if (wh > 999) dockapp_copyarea(parts, pixmap, (wh/1000)*5 + light_offset, 40, 5, 9, 10, 46);
+  dockapp_copyarea(parts, pixmap, ((wh/100) % 10)*5 + light_offset, 40, 5, 9, 16, 46);
+  dockapp_copyarea(parts, pixmap, ((wh/10) % 10)*5 + light_offset, 40, 5, 9, 22, 46);
+  dockapp_copyarea(parts, pixmap, 0, 58, 2, 3, 28, 53);  /*. */
+  dockapp_copyarea(parts, pixmap, (wh%10)*5 + light_offset, 40, 5, 9, 31, 46);
+  dockapp_copyarea(parts, pixmap, 5 + light_offset, 49, 5, 9, 37, 46);  /*W */
+  /* h: the sides and middle bar of a 6 between the dark ends of a 4 */
+  dockapp_copyarea(parts, pixmap, 20 + light_offset, 40, 5, 1, 43, 46);
+  dockapp_copyarea(parts, pixmap, 30 + light_offset, 41, 5, 7, 43, 47);
+  dockapp_copyarea(parts, pixmap, 20 + light_offset, 48, 5, 1, 43, 54);
+}
+
+
 static void draw_statusdigit(AcpiInfos infos) {
   int light_offset=0;
   if (backlight == LIGHTON) {
@@ -770,8 +1421,12 @@ static void draw_statusdigit(AcpiInfos infos) {
 
 
 static void draw_rate(AcpiInfos infos) {
+  draw_milliwatts((infos.rate[0]+infos.rate[1])/1000);
+}
+
+
+static void draw_milliwatts(long rate) {
   int light_offset=0;
-  long rate = (infos.rate[0]+infos.rate[1])/1000;
   if (backlight == LIGHTON) {
     light_offset=50;
   }
@@ -812,8 +1467,6 @@ static void draw_pcgraph(AcpiInfos infos) {
 
 static void parse_arguments(int argc, char **argv) {
   int i;
-  int integer;
-  char character;
 
   for (i = 1; i < argc; i++) { /* first search for config file option */
     if (!strcmp(argv[i], "--config") || !strcmp(argv[i], "-c")) {
@@ -823,77 +1476,16 @@ static void parse_arguments(int argc, char **argv) {
     }
   }
   /* parse config file before other command line options, to allow overriding */
+  options_defaults(options);
   parse_config_file(config_file);
   for (i = 1; i < argc; i++) {
     if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
       print_help(argv[0]), exit(0);
     } else if (!strcmp(argv[i], "--version") || !strcmp(argv[i], "-v")) {
       printf("%s version %s\n", PACKAGE, VERSION), exit(0);
-    } else if (!strcmp(argv[i], "--display") || !strcmp(argv[i], "-d")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      display_name = argv[i + 1];
-      i++;
-    } else if (!strcmp(argv[i], "--backlight") || !strcmp(argv[i], "-bl")) {
-      backlight = LIGHTON;
-    } else if (!strcmp(argv[i], "--light-color") || !strcmp(argv[i], "-lc")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      strcpy(light_color,argv[i + 1]);
-      i++;
     } else if (!strcmp(argv[i], "--config") || !strcmp(argv[i], "-c")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      config_file = argv[i + 1];
-      i++;
-    } else if (!strcmp(argv[i], "--interval") || !strcmp(argv[i], "-i")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (sscanf(argv[i + 1], "%i", &integer) != 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (integer < 100) { fprintf(stderr, "%s: argument %s must be >=100\n", argv[0], argv[i]); exit(1); }
-      update_interval = integer;
-      i++;
-    } else if (!strcmp(argv[i], "--alarm") || !strcmp(argv[i], "-a")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (sscanf(argv[i + 1], "%i", &integer) != 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if ( (integer < 0) || (integer > 125) ) { fprintf(stderr, "%s: argument %s must be >=0 and <=125\n", argv[0], argv[i]); exit(1); }
-      alarm_level = integer;
       i++;
-    } else if (!strcmp(argv[i], "--windowed") || !strcmp(argv[i], "-w")) {
-      dockapp_iswindowed = True;
-    } else if (!strcmp(argv[i], "--broken-wm") || !strcmp(argv[i], "-bw")) {
-      dockapp_isbrokenwm = True;
-    } else if (!strcmp(argv[i], "--notify") || !strcmp(argv[i], "-n")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      notif_cmd = argv[i + 1];
-      i++;
-    } else if (!strcmp(argv[i], "--suspend") || !strcmp(argv[i], "-s")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      suspend_cmd = argv[i + 1];
-      i++;
-    } else if (!strcmp(argv[i], "--togglespeed") || !strcmp(argv[i], "-ts")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (sscanf(argv[i + 1], "%i", &integer) != 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (integer < 100) { fprintf(stderr, "%s: argument %s must be >=100\n", argv[0], argv[i]); exit(1); }
-      togglespeed=integer;
-      i++;
-    } else if (!strcmp(argv[i], "--animationspeed") || !strcmp(argv[i], "-as")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (sscanf(argv[i + 1], "%i", &integer) != 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (integer < 100) { fprintf(stderr, "%s: argument %s must be >=100\n", argv[0], argv[i]); exit(1); }
-      animationspeed=integer;
-      i++;
-    } else if (!strcmp(argv[i], "--historysize") || !strcmp(argv[i], "-hs")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (sscanf(argv[i + 1], "%i", &integer) != 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (integer < 1 || integer > 1000) { fprintf(stderr, "%s: argument %s must be >=1 && <=1000\n", argv[0], argv[i]); exit(1); }
-      history_size=integer;
-      i++;
-    } else if (!strcmp(argv[i], "--mode") || !strcmp(argv[i], "-m")) {
-      if (argc == i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (sscanf(argv[i + 1], "%c", &character) != 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[i]); exit(1); }
-      if (!(character=='t' || character=='r' || character=='s')) { fprintf(stderr, "%s: argument %s must be t, r or s\n", argv[0], argv[i]); exit(1); }
-      if(character=='s') togglemode=1;
-      else if(character=='t') mode=TEMP;
-      else if(character=='r') mode=RATE;
-      i++;
-    } else {
+    } else if (options_parse_arg(options, argc, argv, &i) < 0) {
       fprintf(stderr, "%s: unrecognized option '%s'\n", argv[0], argv[i]);
       print_help(argv[0]);
       exit(1);
@@ -905,7 +1497,8 @@ static void parse_arguments(int argc, char **argv) {
 static void print_help(char *prog) {
   printf("Usage: %s [OPTIONS]\n"
    "%s - Window Maker battery monitor dockapp\n"
-   "  -d,  --display <string>        display to use\n"
+   "  -d,  --display <string>        display to use, may be repeated or\n"
+   "                                 a comma separated list\n"
    "  -bl, --backlight               turn on backlight\n"
    "  -lc, --light-color <string>    backlight colour (rgb:6E/C6/3B is default)\n"
    "  -c,  --config <string>         set filename of config file\n"
@@ -917,8 +1510,24 @@ static void print_help(char *prog) {
    "  -bw, --broken-wm               activate broken window manager fix\n"
    "  -n,  --notify <string>         command to launch when alarm is on\n"
    "  -s,  --suspend <string>        set command for acpi suspend\n"
-   "  -m,  --mode [t|r|s]            set mode for the lower row (=%c), \n"
-   "                                 t=temperature, r=current rate, s=toggle\n"
+   "  -S,  --socket <path>           serve battery state on a unix socket\n"
+   "  -M,  --shm <name>              publish battery state in shared memory\n"
+   "       --metrics <path>          write OpenMetrics for node_exporter to <path>\n"
+   "       --procs <n>               attribute the power to processes, reading\n"
+   "                                 <n> of them per sample\n"
+   "       --upower <bus>            batteries from UPower on the system bus,\n"
+   "                                 the session bus or a bus address\n"
+   "       --policy-root <dir>       take the policy files below <dir>\n"
+   "       --policy-dry-run          only log the policy writes\n"
+   "       --stream <template|json>  print status lines on stdout instead of\n"
+   "                                 opening a window, see the man page\n"
+   "       --once                    print one status line and exit\n"
+   "       --health-log <path>       log battery wear to <path>\n"
+   "       --energy-log <path>       keep the energy totals in <path>\n"
+   "       --health-report           summarize the battery wear log and exit\n"
+   "  -m,  --mode [t|r|e|s]          set mode for the lower row (=%c), \n"
+   "                                 t=temperature, r=current rate,\n"
+   "                                 e=energy used today, s=toggle\n"
    "  -ts  --togglespeed <int>       set toggle speed in msec (=%u)\n"
    "  -as  --animationspeed <int>    set speed for charging animation in msec (=%u)\n"
    "  -hs  --historysize <int>       set size of history for calculating\n"
@@ -935,123 +1544,285 @@ int acpi_exists() {
 }
 
 
-static int my_system (char *cmd) {
-  int           pid;
-  extern char **environ;
-
-  if (cmd == 0) return 1;
-  pid = fork ();
-  if (pid == -1) return -1;
-  if (pid == 0) {
-    pid = fork ();
-    if (pid == 0) {
-      char *argv[4];
-      argv[0] = "sh";
-      argv[1] = "-c";
-      argv[2] = cmd;
-      argv[3] = 0;
-      execve ("/bin/sh", argv, environ);
-      exit (0);
+#ifdef __linux
+
+static void add_source(const char *path, int tier, unsigned stale, char *buf, int size) {
+  Source *s = &sources[nsources++];
+
+  snprintf(s->path, sizeof(s->path), "%.255s", path);
+  s->tier = tier;
+  s->stale = stale;
+  s->fd = -1;
+  s->lat = -1;
+  s->buf = buf;
+  s->size = size;
+}
+
+
+/* opens a source on first use and again after it failed */
+static int source_fd(Source *s) {
+  if (s->fd < 0) {
+    if ((s->fd = open(s->path, O_RDONLY | O_CLOEXEC)) < 0) {
+      DPRINTF("open(%s) error\n", s->path)
+    } else {
+      s->lat = latency_source(s->path);
+    }
+  }
+  return s->fd;
+}
+
+
+static void drop_fd(int *fd) {
+  if (*fd >= 0) close(*fd);
+  *fd = -1;
+}
+
+
+static void close_sources(void) {
+  int n;
+
+  for (n = 0; n < nsources; n++) drop_fd(&sources[n].fd);
+}
+
+
+/*
+ * Status, power and charge have sysfs files of their own next to the
+ * uevent file. Reading those is much cheaper than the whole uevent, which
+ * makes the driver query every property of the battery.
+ */
+static int find_attributes(int bat) {
+  const char *names[ATTRS] = { "POWER_SUPPLY_STATUS", pwrnow_id, chgnow_id };
+  char  *slash, *p;
+  int   a, len;
+
+  /* the wear estimate wants voltage and current with every sample */
+  if (health_log) return 0;
+  if (!(slash = strrchr(uevent_files[bat], '/')) || strcmp(slash, "/uevent")) return 0;
+  len = slash - uevent_files[bat];
+  for (a = 0; a < ATTRS; a++) {
+    snprintf(attr_files[bat][a], sizeof(attr_files[bat][a]), "%.*s/%s",
+             len, uevent_files[bat], names[a] + 13);
+    for (p = attr_files[bat][a] + len + 1; *p; p++) *p = tolower(*p);
+    if (access(attr_files[bat][a], R_OK)) return 0;
+  }
+  return 1;
+}
+
+
+/* builds the source table for the batteries init_stats() found */
+static void setup_sources(void) {
+  int bat, a;
+
+  close_sources();
+  nsources = 0;
+  add_source(ac_state, TIER_FAST, STALE_AC, ac_buf, sizeof(ac_buf));
+  for (bat = 0; bat < number_of_batteries; bat++) {
+    if ((attr_src[bat] = find_attributes(bat) ? nsources : -1) >= 0) {
+      for (a = 0; a < ATTRS; a++)
+        add_source(attr_files[bat][a], TIER_FAST, STALE_BAT0 << bat, attr_buf[bat][a], sizeof(attr_buf[bat][a]));
+      DPRINTF("D: BAT%d status, power and charge from their own files\n", bat)
     }
-    exit (0);
+    /* with the attributes at hand the uevent file is only needed for the full capacity */
+    add_source(uevent_files[bat], attr_src[bat] >= 0 ? TIER_CAPACITY : TIER_FAST,
+               STALE_BAT0 << bat, uevent_buf[bat], MAXSTRLEN);
+  }
+}
+
+
+/* value of a POWER_SUPPLY_ key in a uevent file */
+static int uevent_long(const char *buf, const char *key, long *val) {
+  const char *p = buf;
+  int len = strlen(key);
+
+  while ((p = strstr(p, key))) {
+    if (p[len] == '=' && (p == buf || p[-1] == '\n')) {
+      *val = strtol(p + len + 1, NULL, 10);
+      return 1;
+    }
+    p += len;
   }
   return 0;
 }
 
 
-#ifdef __linux
+static int battery_status(char c) {
+  switch (c) {
+    case 'D': return DISCHARGING;
+    case 'C': return CHARGING;
+    default:  return UNKNOWN;
+  }
+}
+
+
+static void add_read(SysRead *r, int fd, char *buf, int size, unsigned tag) {
+  r->fd = fd;
+  r->buf = buf;
+  r->size = size;
+  r->tag = tag;
+}
+
 
 int acpi_read(AcpiInfos *i) {
-  FILE      *fd;
-  static int rhptr = 0;
+  SysRead   reads[NSOURCES + THERMAL_MAX_SOURCES];
+  UPowerState up;
+  static int rhptr = 0, was_upower = 0;
   int       ret = 0;
   int       bat;
-  char      *buf;
+  int       n = 0, r, nthermal = 0, upower;
+  unsigned  due, tried = 0, begun = 0, fast = 0, got = 0;
+  long      took[8] = { 0 };
+  long      status[2] = { -1, -1 }, power[2] = { -1, -1 };
+  long      energy[2] = { -1, -1 }, full[2] = { -1, -1 };
+  Source    *s;
   char      *ptr;
   int       hist;
+  int       temp;
   long      tmp;
   float     time;
   long      allcapacity=0;
   long      allremain=0;
 
-  buf=(char *)malloc(sizeof(char)*MAXSTRLEN);
+  /* with UPower running only the temperature is ours to read */
+  upower = upower_get(&up) == 0;
+  if (upower != was_upower) {
+    /* UPower counts in uW/uWh, sysfs may count in uA/uAh: nothing of
+       the other backend can be mixed with the new values */
+    was_upower = upower;
+    for (bat = 0; bat < 2; bat++) {
+      for (hist = 0; hist < history_size; hist++) i->ratehist[bat][hist] = 0;
+      i->remain[bat] = i->currcap[bat] = 0;
+    }
+    schedule_force(~0u);
+    DPRINTF("D: batteries from %s\n", upower ? "UPower" : "sysfs")
+  }
+  if (i->amps != (!upower && !strcmp(pwrnow_id, "POWER_SUPPLY_CURRENT_NOW"))) {
+    i->amps = !i->amps;
+    ret = 1;
+  }
 
-  /* get acpi thermal cpu info */
-  if ((fd = fopen(thermal, "r"))) {
-    if (fscanf(fd, "%ld", &tmp)) {
-      tmp /= 100;
-      if (i->thermal_temp != tmp) {
-        i->thermal_temp = tmp;
-        ret = 1;
-      }
-    } else {
-      DPRINTF("fscanf(%s) error\n", thermal)
+  /* every file due this sample goes into one batch */
+  due = schedule_due(update_interval / 2);
+  if (!__atomic_load_n(&thermal_wanted, __ATOMIC_RELAXED)) {
+    due &= ~TIER(TIER_THERMAL);
+    /* nor should an old reading keep deep idle off */
+    if (i->thermal_temp) {
+      i->thermal_temp = 0;
+      ret = 1;
     }
-    fclose(fd);
-  } else {
-    DPRINTF("fopen(%s) error\n", thermal)
+  }
+  for (s = sources; s < sources + nsources && !upower; s++) {
+    if (!(due & TIER(s->tier))) continue;
+    /* a stale source keeps its last values */
+    if (!(tried & s->stale)) {
+      tried |= s->stale;
+      if (sampler_begin(s->stale)) begun |= s->stale;
+    }
+    if (!(begun & s->stale)) continue;
+    if (s->tier == TIER_FAST) fast |= s->stale;
+    if (source_fd(s) >= 0) add_read(&reads[n++], s->fd, s->buf, s->size, s - sources);
+  }
+  if ((due & TIER(TIER_THERMAL)) && sampler_begin(STALE_THERMAL)) {
+    begun |= STALE_THERMAL;
+    nthermal = thermal_prepare(reads + n, THERMAL_MAX_SOURCES);
+  }
+  sysread_batch(reads, n + nthermal);
+
+  for (r = 0; r < n; r++) {
+    s = &sources[reads[r].tag];
+    latency_add(s->lat, reads[r].usec);
+    if (reads[r].usec > took[__builtin_ctz(s->stale)]) took[__builtin_ctz(s->stale)] = reads[r].usec;
+    if (reads[r].len <= 0) {
+      DPRINTF("read(%s) error\n", s->path)
+      drop_fd(&s->fd);
+      continue;
+    }
+    got |= 1u << reads[r].tag;
+  }
+
+  /* get the aggregated temperature of all thermal sources */
+  for (r = n; r < n + nthermal; r++)
+    if (reads[r].usec > took[__builtin_ctz(STALE_THERMAL)]) took[__builtin_ctz(STALE_THERMAL)] = reads[r].usec;
+  if (nthermal && thermal_finish(reads + n, nthermal, &temp) == 0) {
+    if (i->thermal_temp != temp) {
+      i->thermal_temp = temp;
+      ret = 1;
+    }
+  } else if (begun & STALE_THERMAL) {
+    DPRINTF("no temperature reading\n")
   }
 
   /* get ac power state */
-  if ((fd = fopen(ac_state, "r"))) {
-    if (fread(buf,1,1,fd)) {
-      buf[0] -= '0';
-      if(buf[0] != i->ac_line_status) {
-        i->ac_line_status = buf[0];
-        ret = 1;
+  if ((got & 1) && ac_buf[0] - '0' != i->ac_line_status) {
+    i->ac_line_status = ac_buf[0] - '0';
+    ret = 1;
+  }
+
+  /* collect the battery values from whichever files were read */
+  for (r = 1; r < nsources; r++) {
+    if (!(got & (1u << r))) continue;
+    s = &sources[r];
+    bat = __builtin_ctz(s->stale / STALE_BAT0);
+    if (s->buf == uevent_buf[bat]) {
+      health_sample(bat, s->buf);
+      uevent_long(s->buf, full_id, &full[bat]);
+      if (attr_src[bat] >= 0) continue;
+      if ((ptr = strstr(s->buf, "POWER_SUPPLY_STATUS="))) {
+        status[bat] = battery_status(ptr[20]);
+      } else {
+        DPRINTF("POWER_SUPPLY_STATUS not found\n")
+      }
+      if (!uevent_long(s->buf, pwrnow_id, &power[bat])) {
+        DPRINTF("%s not found\n", pwrnow_id)
+      }
+      if (!uevent_long(s->buf, chgnow_id, &energy[bat])) {
+        DPRINTF("%s not found\n", chgnow_id)
       }
+    } else if (s->buf == attr_buf[bat][ATTR_STATUS]) {
+      status[bat] = battery_status(s->buf[0]);
+    } else if (s->buf == attr_buf[bat][ATTR_POWER]) {
+      power[bat] = atol(s->buf);
     } else {
-      DPRINTF("fread(%s) error\n", ac_state)
+      energy[bat] = atol(s->buf);
+    }
+  }
+
+  if (upower) {
+    if (up.online != i->ac_line_status) {
+      i->ac_line_status = up.online;
+      ret = 1;
+    }
+    for (bat = 0; bat < up.nbat; bat++) {
+      status[bat] = up.bat[bat].status;
+      power[bat] = up.bat[bat].rate;
+      energy[bat] = up.bat[bat].energy;
+      full[bat] = up.bat[bat].full;
+      i->design[bat] = up.bat[bat].design;
+      fast |= STALE_BAT0 << bat;
     }
-    fclose(fd);
-  } else {
-    DPRINTF("fopen(%s) error\n", ac_state)
   }
 
   /* get battery statuses */
   for(bat=0;bat<number_of_batteries;bat++) {
-    i->ratehist[bat][rhptr] = 0;
-    if ((fd = fopen(uevent_files[bat], "r"))) {
-      bzero(buf, MAXSTRLEN);
-      if (fread(buf, 1, MAXSTRLEN, fd)) {
-        if ((ptr = strstr(buf,"POWER_SUPPLY_STATUS"))) {
-          switch (ptr[20]) {
-            case 'D': tmp=DISCHARGING; break;
-            case 'C': tmp=CHARGING; break;
-            default: tmp=UNKNOWN; break;
-          }
-          if (i->battery_status[bat] != tmp) {
-            i->battery_status[bat] = tmp;
-            ret = 1;
-          }
-        } else {
-          DPRINTF("POWER_SUPPLY_STATUS not found\n")
-        }
-        if ((ptr = strstr(ptr, pwrnow_id))) {
-          ptr = strstr(ptr, "=");
-          sscanf(ptr+1, "%ld", &i->ratehist[bat][rhptr]);
-        } else {
-          DPRINTF("POWER_SUPPLY_POWER_NOW not found (order?)\n")
-        }
-        if ((ptr = strstr(ptr, chgnow_id))) {
-          ptr = strstr(ptr, "=");
-          sscanf(ptr+1, "%ld", &tmp);
-          if (i->remain[bat] != tmp) {
-            i->remain[bat] = tmp;
-            if (tmp > i->currcap[bat]) i->currcap[bat] = tmp;
-            i->battery_percentage[bat] = ((float)(i->remain[bat]) * 100.0f / (float)i->currcap[bat]);
-            ret = 1;
-          }
-        } else {
-          DPRINTF("POWER_SUPPLY_ENERGY_NOW not found (order?)\n")
-        }
-      } else {
-        DPRINTF("fread(%s) error\n", uevent_files[bat])
-      }
-      fclose(fd);
-    } else {
-      DPRINTF("fopen(%s) error\n", uevent_files[bat])
+    if (status[bat] >= 0 && i->battery_status[bat] != status[bat]) {
+      i->battery_status[bat] = status[bat];
+      ret = 1;
     }
+    /* the full capacity drifts with wear and calibration, both ways */
+    if (full[bat] > 0 && full[bat] != i->currcap[bat]) {
+      i->currcap[bat] = full[bat] > i->remain[bat] ? full[bat] : i->remain[bat];
+      i->battery_percentage[bat] = ((float)(i->remain[bat]) * 100.0f / (float)i->currcap[bat]);
+      ret = 1;
+    }
+    if (energy[bat] >= 0 && i->remain[bat] != energy[bat]) {
+      i->remain[bat] = energy[bat];
+      if (energy[bat] > i->currcap[bat]) i->currcap[bat] = energy[bat];
+      i->battery_percentage[bat] = ((float)(i->remain[bat]) * 100.0f / (float)i->currcap[bat]);
+      ret = 1;
+    }
+    /* the rate history only moves with the fast reads */
+    if (!(fast & (STALE_BAT0 << bat))) continue;
+    i->ratehist[bat][rhptr] = power[bat] > 0 ? power[bat] : 0;
+    i->power[bat] = i->ratehist[bat][rhptr];
 
     /* calc average */
     tmp = 0;
@@ -1070,7 +1841,13 @@ int acpi_read(AcpiInfos *i) {
     }
 
   }
+  for (r = 0; r < 8; r++)
+    if (begun & (1u << r)) sampler_end(1u << r, took[r] / 1000);
   if (++rhptr >= history_size) rhptr = 0;
+  if (i->stale != sampler_stale()) {
+    i->stale = sampler_stale();
+    ret = 1;
+  }
 
   if (ret) {
     /* calc remaining time (only if something has changed) */
@@ -1084,25 +1861,24 @@ int acpi_read(AcpiInfos *i) {
       i->minutes_left=0;
     }
     if((i->battery_status[0] == CHARGING || i->battery_status[1] == CHARGING) && (i->rate[0]>0 || i->rate[1]>0)) {
-      time = (float)(cur_acpi_infos.currcap[0] - i->remain[0] + cur_acpi_infos.currcap[1] - i->remain[1])/(float)(i->rate[0]+i->rate[1]);
+      time = (float)(i->currcap[0] - i->remain[0] + i->currcap[1] - i->remain[1])/(float)(i->rate[0]+i->rate[1]);
       i->hours_left=(int)time;
       i->minutes_left=(int)(60*(time-(int)time));
     }
     for(bat=0;bat<number_of_batteries;bat++) {
       allremain += i->remain[bat];
-      allcapacity += cur_acpi_infos.currcap[bat];
+      allcapacity += i->currcap[bat];
     }
 
-    cur_acpi_infos.low=0;
+    i->low=0;
     if(allcapacity>0) {
       if(((float)allremain / (float)allcapacity * 100.0f) < alarm_level) {
-        cur_acpi_infos.low = 1;
-        if((float)allremain / (float)allcapacity < 0.05f) cur_acpi_infos.low = 2;
+        i->low = 1;
+        if((float)allremain / (float)allcapacity * 100.0f < critical_level) i->low = 2;
       }
     }
   }
 
-  free(buf);
   return ret;
 }
 #endif
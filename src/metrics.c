@@ -0,0 +1,154 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "metrics.h"
+#include "governor.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#define METRICS_LEN   4096
+
+static char   path[256];
+static char   tmp_path[sizeof(path) + 4];
+static char   text[2][METRICS_LEN];   /* rendered now, last written */
+static int    written = -1;           /* length of text[1], -1 if none */
+static long   interval;
+static long   last_write;             /* msec */
+
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+int metrics_open(const char *file, long msec) {
+  if (strlen(file) >= sizeof(path)) {
+    fprintf(stderr, "metrics file name too long\n");
+    return -1;
+  }
+  strcpy(path, file);
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  interval = msec;
+  written = -1;
+  DPRINTF("D: writing metrics to '%s'\n", path)
+  return 0;
+}
+
+
+void metrics_configure(long msec) {
+  interval = msec;
+}
+
+
+void metrics_close(void) {
+  /* no numbers are better than old numbers */
+  if (path[0]) unlink(path);
+  path[0] = '\0';
+}
+
+
+/* appends to text[0], HELP and TYPE go with the first sample of a family */
+static int add(int pos, const char *family, const char *help, const char *labels, double value) {
+  if (help)
+    pos += snprintf(text[0] + pos, METRICS_LEN - pos,
+                    "# TYPE wmbatteries_%s gauge\n# HELP wmbatteries_%s %s\n", family, family, help);
+  if (pos < METRICS_LEN)
+    pos += snprintf(text[0] + pos, METRICS_LEN - pos, "wmbatteries_%s%s %.6g\n", family, labels, value);
+  return pos < METRICS_LEN ? pos : METRICS_LEN;
+}
+
+
+static int render(const AcpiInfos *k, int nbat, int amps) {
+  static const char *label[2] = { "{battery=\"0\"}", "{battery=\"1\"}" };
+  const char *rate = amps ? "current_amperes" : "power_watts";
+  const char *help;
+  Cost  cost;
+  int   pos = 0, bat;
+
+  for (bat = 0; bat < nbat; bat++)
+    pos = add(pos, "charge_ratio", bat ? NULL : "State of charge.", label[bat],
+              k->currcap[bat] > 0 ? (double)k->remain[bat] / k->currcap[bat] : 0);
+  for (bat = 0; bat < nbat; bat++)
+    pos = add(pos, rate, bat ? NULL : "Averaged rate of charge or discharge.", label[bat],
+              k->rate[bat] / 1e6);
+  /* left out where the design capacity is unknown */
+  for (bat = 0, help = "Full capacity over design capacity."; bat < nbat; bat++)
+    if (k->design[bat] > 0) {
+      pos = add(pos, "health_ratio", help, label[bat], (double)k->currcap[bat] / k->design[bat]);
+      help = NULL;
+    }
+  for (bat = 0; bat < nbat; bat++)
+    pos = add(pos, "charging", bat ? NULL : "1 while charging, 0 while discharging, -1 otherwise.",
+              label[bat], k->battery_status[bat] == CHARGING ? 1 :
+                          k->battery_status[bat] == DISCHARGING ? 0 : -1);
+  pos = add(pos, "remaining_seconds", "Time until empty or full, 0 if neither.", "",
+            k->hours_left * 3600 + k->minutes_left * 60);
+  pos = add(pos, "ac_online", "1 on AC power.", "", k->ac_line_status == 1);
+  pos = add(pos, "temperature_celsius", "Temperature of the thermal_policy sensors.", "",
+            k->thermal_temp / 10.0);
+
+  /* the cost of watching, per the last governor window */
+  governor_cost(&cost);
+  pos = add(pos, "cpu_ratio", "CPU time used by wmbatteries.", "", cost.cpu / 1e6);
+  pos = add(pos, "wakeups_per_second", "Wakeups of wmbatteries.", "", cost.wakeups / 60.0);
+  pos = add(pos, "sysfs_read_ratio", "Time spent reading sysfs.", "", cost.reads / 1e6);
+  if (pos < METRICS_LEN) pos += snprintf(text[0] + pos, METRICS_LEN - pos, "# EOF\n");
+  return pos < METRICS_LEN ? pos : -1;
+}
+
+
+void metrics_update(const AcpiInfos *infos, int nbat, int amps) {
+  long  now = now_ms();
+  int   fd, len, ok;
+
+  if (!path[0] || (written >= 0 && now - last_write < interval)) return;
+  if ((len = render(infos, nbat, amps)) < 0) {
+    DPRINTF("D: metrics don't fit into %d bytes\n", METRICS_LEN)
+    return;
+  }
+  if (len == written && !memcmp(text[0], text[1], len)) return;
+
+  if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+    fprintf(stderr, "open(%s): %s\n", tmp_path, strerror(errno));
+    path[0] = '\0';
+    return;
+  }
+  ok = write(fd, text[0], len) == len;
+  ok = close(fd) == 0 && ok;
+  /* the collector either sees the old file or the new one, never half */
+  if (!ok || rename(tmp_path, path) < 0) {
+    DPRINTF("D: writing '%s' failed: %s\n", path, strerror(errno))
+    unlink(tmp_path);
+    return;
+  }
+  memcpy(text[1], text[0], len);
+  written = len;
+  last_write = now;
+}
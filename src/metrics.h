@@ -0,0 +1,35 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "wmbatteries.h"
+
+/*
+ * OpenMetrics text file for node_exporter's textfile collector. The file
+ * is rendered into a static buffer after every sample and only written,
+ * to a temporary file that is then renamed over it, when the text differs
+ * from the last one written and 'interval' msec have passed since.
+ */
+int  metrics_open(const char *path, long interval);
+void metrics_configure(long interval);
+/* 'amps' if the rates are currents in uA rather than power in uW */
+void metrics_update(const AcpiInfos *infos, int nbat, int amps);
+void metrics_close(void);
+
+#endif	/* ifndef METRICS_H */
@@ -0,0 +1,317 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "options.h"
+#include "dockapp.h"
+#include "wmbatteries.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+
+#ifdef __linux
+# include <sys/inotify.h>
+#endif
+
+
+/* returns 1 if the value changed, 0 if not, -1 (with *err set) if invalid */
+static int set_value(Option *o, const char *value, char *err, int errlen) {
+  char  *end;
+  long  l;
+  int   *ip = o->var;
+  char  **sp = o->var;
+
+  if (o->type != OPT_FLAG && (value == NULL || !value[0])) {
+    snprintf(err, errlen, "missing value");
+    return -1;
+  }
+
+  switch (o->type) {
+  case OPT_FLAG:
+    if (*ip == 1) return 0;
+    *ip = 1;
+    return 1;
+
+  case OPT_BOOL:
+    if (!strcasecmp(value, "yes") || !strcasecmp(value, "true")) l = 1;
+    else if (!strcasecmp(value, "no") || !strcasecmp(value, "false")) l = 0;
+    else {
+      snprintf(err, errlen, "use yes/no or true/false");
+      return -1;
+    }
+    if (*ip == l) return 0;
+    *ip = l;
+    return 1;
+
+  case OPT_INT:
+    errno = 0;
+    l = strtol(value, &end, 0);
+    if (errno || *end || end == value) {
+      snprintf(err, errlen, "'%s' is not a number", value);
+      return -1;
+    }
+    if (l < o->min || l > o->max) {
+      if (o->max == INT_MAX)
+        snprintf(err, errlen, "must be >= %d", o->min);
+      else
+        snprintf(err, errlen, "must be >= %d and <= %d", o->min, o->max);
+      return -1;
+    }
+    if (*ip == l) return 0;
+    *ip = l;
+    return 1;
+
+  case OPT_STRING:
+    if (*sp && !strcmp(*sp, value)) return 0;
+    /* defaults and argv strings are not ours, only earlier copies are */
+    if (o->allocated) free(*sp);
+    if (!((*sp = strdup(value)))) exit(-1);
+    o->allocated = 1;
+    return 1;
+
+  case OPT_BUFFER:
+    if ((int)strlen(value) >= o->max) {
+      snprintf(err, errlen, "longer than %d characters", o->max - 1);
+      return -1;
+    }
+    if (!strcmp(o->var, value)) return 0;
+    strcpy(o->var, value);
+    return 1;
+
+  case OPT_CUSTOM:
+    l = o->parse(value);
+    if (l < 0) {
+      snprintf(err, errlen, "invalid value '%s'", value);
+      return -1;
+    }
+    return l;
+  }
+  return 0;
+}
+
+
+void options_defaults(Option *table) {
+  Option *o;
+
+  for (o = table; o->key || o->lng; o++) {
+    switch (o->type) {
+    case OPT_FLAG:
+    case OPT_BOOL:
+    case OPT_INT:
+      o->def_int = *(int *)o->var;
+      break;
+    case OPT_STRING:
+      o->def_str = *(char **)o->var;
+      break;
+    case OPT_BUFFER:
+      if (!((o->def_str = strdup(o->var)))) exit(-1);
+      break;
+    case OPT_CUSTOM:
+      break;
+    }
+  }
+}
+
+
+/* back to the value options_defaults() saw, returns 1 if that changed it */
+static int restore(Option *o) {
+  char **sp = o->var;
+
+  switch (o->type) {
+  case OPT_FLAG:
+  case OPT_BOOL:
+  case OPT_INT:
+    if (*(int *)o->var == o->def_int) return 0;
+    *(int *)o->var = o->def_int;
+    return 1;
+  case OPT_STRING:
+    if (*sp == o->def_str || (*sp && o->def_str && !strcmp(*sp, o->def_str))) return 0;
+    if (o->allocated) free(*sp);
+    *sp = o->def_str;
+    o->allocated = 0;
+    return 1;
+  case OPT_BUFFER:
+    if (!o->def_str || !strcmp(o->var, o->def_str)) return 0;
+    strcpy(o->var, o->def_str);
+    return 1;
+  case OPT_CUSTOM:
+    break;
+  }
+  return 0;
+}
+
+
+/* set on the command line, maybe through another entry for the same variable */
+static int from_cmdline(const Option *table, const Option *o) {
+  const Option *other;
+
+  for (other = table; other->key || other->lng; other++)
+    if (other->from_cmdline && (other == o || (o->var && other->var == o->var))) return 1;
+  return 0;
+}
+
+
+/* strips leading and trailing blanks and a leading '=' separator */
+static char *trim_value(char *value) {
+  char *end;
+
+  value += strspn(value, " \t");
+  if (*value == '=') value++;
+  value += strspn(value, " \t");
+  end = value + strlen(value);
+  while (end > value && strchr(" \t\r\n", end[-1])) end--;
+  *end = '\0';
+  return value;
+}
+
+
+int options_parse_file(Option *table, const char *path, int reload) {
+  FILE    *fd;
+  char    *buf = NULL;
+  size_t  len = 0;
+  char    *item, *value;
+  char    err[128];
+  Option  *o;
+  int     linenr = 0;
+  int     changed = 0;
+
+  if (!((fd = fopen(path, "r")))) return -1;
+  for (o = table; o->key || o->lng; o++) o->seen = 0;
+
+  while (getline(&buf, &len, fd) != -1) {
+    linenr++;
+    item = buf + strspn(buf, " \t");
+    if (*item == '#' || *item == '\n' || *item == '\0') continue;
+    value = item + strcspn(item, " \t=\r\n");
+    if (*value) *value++ = '\0';
+    value = trim_value(value);
+
+    for (o = table; o->key || o->lng; o++)
+      if (o->key && !strcmp(o->key, item)) break;
+    if (!o->key) {
+      printf("unknown option '%s' in line %i\n", item, linenr);
+      continue;
+    }
+    /* command line settings win, also over later edits of the file */
+    if (from_cmdline(table, o) || (reload && !(o->flags & OPT_LIVE))) continue;
+    o->seen = 1;
+
+    switch (set_value(o, value, err, sizeof(err))) {
+    case -1: printf("%s option wrong in line %i, %s\n", item, linenr, err); break;
+    case 1:  changed++; break;
+    }
+  }
+  free(buf);
+  fclose(fd);
+  /* a line taken out of the file means the default again */
+  if (reload)
+    for (o = table; o->key || o->lng; o++)
+      if (o->key && (o->flags & OPT_LIVE) && !o->seen && !from_cmdline(table, o)) changed += restore(o);
+  return changed;
+}
+
+
+int options_parse_arg(Option *table, int argc, char **argv, int *i) {
+  char    err[128];
+  Option  *o;
+  const char *value = NULL;
+
+  for (o = table; o->key || o->lng; o++)
+    if ((o->lng && !strcmp(argv[*i], o->lng)) ||
+        (o->shrt && !strcmp(argv[*i], o->shrt))) break;
+  if (!o->key && !o->lng) return -1;
+
+  if (o->type != OPT_FLAG) {
+    if (argc == *i + 1) { fprintf(stderr, "%s: error parsing argument for option %s\n", argv[0], argv[*i]); exit(1); }
+    value = argv[*i + 1];
+  }
+  if (set_value(o, value, err, sizeof(err)) < 0) {
+    fprintf(stderr, "%s: argument %s %s\n", argv[0], argv[*i], err);
+    exit(1);
+  }
+  o->from_cmdline = 1;
+  if (o->type != OPT_FLAG) (*i)++;
+  return 0;
+}
+
+
+#ifdef __linux
+static void (*watch_cb)(void);
+static char watch_name[256];
+
+static void read_inotify(int fd, void *data) {
+  char  buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *ev;
+  ssize_t n;
+  char  *ptr;
+  int   hit = 0;
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    for (ptr = buf; ptr < buf + n; ptr += sizeof(*ev) + ev->len) {
+      ev = (const struct inotify_event *)ptr;
+      if (ev->len && !strcmp(ev->name, watch_name)) hit = 1;
+    }
+  }
+  if (hit) watch_cb();
+}
+#endif
+
+
+int options_watch(const char *path, void (*changed)(void)) {
+#ifdef __linux
+  char  dir[PATH_MAX];
+  const char *base;
+  int   fd;
+
+  /* editors usually replace the file, so watch the directory instead */
+  if ((base = strrchr(path, '/')) == path) {
+    strcpy(dir, "/");
+    base++;
+  } else if (base) {
+    if (base - path >= (int)sizeof(dir)) return -1;
+    memcpy(dir, path, base - path);
+    dir[base - path] = '\0';
+    base++;
+  } else {
+    strcpy(dir, ".");
+    base = path;
+  }
+  if (strlen(base) >= sizeof(watch_name)) return -1;
+  strcpy(watch_name, base);
+
+  if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) return -1;
+  if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+      !dockapp_watch_fd(fd, read_inotify, NULL)) {
+    close(fd);
+    return -1;
+  }
+  watch_cb = changed;
+  DPRINTF("D: watching '%s' in '%s'\n", watch_name, dir)
+  return 0;
+#else
+  return -1;
+#endif
+}
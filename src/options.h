@@ -0,0 +1,60 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+typedef enum {
+  OPT_FLAG,     /* command line switch without argument, sets *var to 1 */
+  OPT_BOOL,     /* yes/no/true/false */
+  OPT_INT,      /* integer within [min,max] */
+  OPT_STRING,   /* malloc'ed copy stored in a char *, the old one freed */
+  OPT_BUFFER,   /* copied into a char array of 'max' bytes */
+  OPT_CUSTOM    /* handed to parse(), var may be NULL */
+} OptionType;
+
+#define OPT_LIVE  0x1   /* picked up again when the config file changes */
+
+/* tables are terminated by an entry with neither key nor long option */
+typedef struct Option {
+  const char  *key;           /* config file keyword, NULL if none */
+  const char  *lng;           /* long command line option, NULL if none */
+  const char  *shrt;          /* short command line option, NULL if none */
+  OptionType  type;
+  void        *var;
+  int         min, max;
+  int         (*parse)(const char *value);  /* 1 changed, 0 same, -1 bad */
+  int         flags;
+  int         from_cmdline;   /* set once given on the command line */
+  int         allocated;      /* OPT_STRING: *var is ours to free */
+  long        def_int;        /* the value before any parsing */
+  char        *def_str;
+  int         seen;           /* in the file last parsed */
+} Option;
+
+/* remembers the built-in values, before anything is parsed */
+void options_defaults(Option *table);
+/*
+ * Returns the number of options whose value changed. On a reload live
+ * options whose line is gone go back to their default, except OPT_CUSTOM
+ * ones, which are left to the caller.
+ */
+int  options_parse_file(Option *table, const char *path, int reload);
+/* parses argv[*i] (and its argument), returns -1 if it is not in the table */
+int  options_parse_arg(Option *table, int argc, char **argv, int *i);
+/* calls 'changed' whenever 'path' is rewritten or replaced */
+int  options_watch(const char *path, void (*changed)(void));
+
+#endif	/* ifndef OPTIONS_H */
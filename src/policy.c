@@ -0,0 +1,291 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+#include "policy.h"
+#include "alarm.h"
+#include "wmbatteries.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+
+#define MAX_RULES   32
+#define MAX_FILES   256
+#define VALUE_LEN   64
+#define POLICY_HYST 2       /* percent or degrees past a level to leave its state */
+
+enum { ST_AC, ST_BATTERY, ST_LOW, ST_CRITICAL, ST_HOT, STATES };
+
+typedef struct Rule {
+  int       state;
+  char      path[256];
+  char      value[VALUE_LEN];
+} Rule;
+
+typedef struct Target {
+  char      path[512];
+  unsigned  rules;              /* bit per rule naming this file */
+  int       known;              /* saved and written are valid */
+  int       broken;             /* reading or writing failed, left alone */
+  char      saved[VALUE_LEN];   /* before the first write */
+  char      written[VALUE_LEN];
+} Target;
+
+static const char *state_names[STATES] = { "ac", "battery", "low", "critical", "hot" };
+/* where a state without a line for a file looks next */
+static const int fallback[STATES] = { -1, -1, ST_BATTERY, ST_LOW, -1 };
+
+static Rule   rules[MAX_RULES];
+static int    nrules;
+static Rule   staged[MAX_RULES];
+static int    nstaged;
+static Target targets[MAX_FILES];
+static int    ntargets;
+static char   root[256];
+static int    dry_run;
+static int    low_level, critical_level, hot_level;
+static int    base = -1;        /* state in force, -1 before the first sample */
+static int    hot;
+static int    fresh = 1;        /* apply the next update in any case */
+
+
+int policy_parse_rule(const char *value) {
+  char  buf[512], *tok, *save;
+  Rule  r;
+  int   i;
+
+  if (nstaged == MAX_RULES || strlen(value) >= sizeof(buf)) return -1;
+  strcpy(buf, value);
+  memset(&r, 0, sizeof(r));
+
+  if (!(tok = strtok_r(buf, " \t", &save))) return -1;
+  for (i = 0; i < STATES && strcmp(tok, state_names[i]); i++);
+  if ((r.state = i) == STATES) return -1;
+  if (!(tok = strtok_r(NULL, " \t", &save)) || *tok != '/' || strlen(tok) >= sizeof(r.path))
+    return -1;
+  strcpy(r.path, tok);
+  /* the rest of the line, as given */
+  if (!save || !*(save += strspn(save, " \t")) || strlen(save) >= sizeof(r.value)) return -1;
+  strcpy(r.value, save);
+  staged[nstaged++] = r;
+  /* whether anything changed is up to policy_commit() */
+  return 0;
+}
+
+
+void policy_begin(void) {
+  nstaged = 0;
+}
+
+
+static int same_rule(const Rule *a, const Rule *b) {
+  return a->state == b->state && !strcmp(a->path, b->path) && !strcmp(a->value, b->value);
+}
+
+
+/* adds the files matching a rule below root, returns how many match */
+static int expand(int rule) {
+  char    pattern[600];
+  glob_t  g;
+  size_t  i;
+  int     t, n;
+
+  snprintf(pattern, sizeof(pattern), "%s%s", root, rules[rule].path);
+  if (glob(pattern, 0, NULL, &g) != 0) return 0;
+  for (i = 0; i < g.gl_pathc; i++) {
+    for (t = 0; t < ntargets && strcmp(targets[t].path, g.gl_pathv[i]); t++);
+    if (t == ntargets) {
+      if (ntargets == MAX_FILES || strlen(g.gl_pathv[i]) >= sizeof(targets[t].path)) continue;
+      memset(&targets[t], 0, sizeof(targets[t]));
+      strcpy(targets[t].path, g.gl_pathv[i]);
+      ntargets++;
+    }
+    targets[t].rules |= 1u << rule;
+  }
+  n = g.gl_pathc;
+  globfree(&g);
+  return n;
+}
+
+
+int policy_commit(const char *new_root, int new_dry_run, int low, int critical, int temp) {
+  int i;
+
+  if (nstaged == nrules && !strcmp(root, new_root) && dry_run == new_dry_run) {
+    for (i = 0; i < nrules && same_rule(&rules[i], &staged[i]); i++);
+    if (i == nrules) {
+      if (low == low_level && critical == critical_level && temp == hot_level) return 0;
+      low_level = low;
+      critical_level = critical;
+      hot_level = temp;
+      fresh = 1;
+      return 1;
+    }
+  }
+  /* the files of the old rules may not be named anymore */
+  policy_restore();
+  ntargets = 0;
+  memcpy(rules, staged, nstaged * sizeof(Rule));
+  nrules = nstaged;
+  snprintf(root, sizeof(root), "%s", new_root);
+  dry_run = new_dry_run;
+  for (i = 0; i < nrules; i++)
+    if (!expand(i)) printf("No policy file matches '%s%s'\n", root, rules[i].path);
+  low_level = low;
+  critical_level = critical;
+  hot_level = temp;
+  base = -1;
+  fresh = 1;
+  DPRINTF("D: %d policy rules on %d files\n", nrules, ntargets)
+  return 1;
+}
+
+
+/* reads a short sysfs attribute into buf, stripping the newline */
+static int read_attr(const char *path, char *buf, int len) {
+  int fd, n;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+  n = read(fd, buf, len - 1);
+  close(fd);
+  if (n <= 0) return -1;
+  buf[n] = '\0';
+  buf[strcspn(buf, "\n")] = '\0';
+  return 0;
+}
+
+
+static int write_value(Target *t, const char *value) {
+  int fd, len = strlen(value), ok = 0;
+
+  if (dry_run) {
+    printf("Power policy: %s = %s (dry run)\n", t->path, value);
+  } else {
+    if ((fd = open(t->path, O_WRONLY | O_TRUNC | O_CLOEXEC)) >= 0) {
+      ok = write(fd, value, len) == len;
+      /* sysfs reports some errors only on close, O_TRUNC is for fake trees */
+      if (close(fd) < 0) ok = 0;
+    }
+    if (!ok) {
+      printf("Power policy: can't write '%s' to %s: %s\n", value, t->path, strerror(errno));
+      t->broken = 1;
+      return 0;
+    }
+    DPRINTF("D: policy %s = %s\n", t->path, value)
+  }
+  snprintf(t->written, sizeof(t->written), "%s", value);
+  return 1;
+}
+
+
+static const char *wanted(const Target *t) {
+  const char *want = NULL;
+  int i, state;
+
+  for (state = base; state >= 0 && !want; state = fallback[state])
+    for (i = 0; i < nrules; i++)
+      if ((t->rules & (1u << i)) && rules[i].state == state) want = rules[i].value;
+  if (hot)
+    for (i = 0; i < nrules; i++)
+      if ((t->rules & (1u << i)) && rules[i].state == ST_HOT) want = rules[i].value;
+  return want;
+}
+
+
+/* brings every file to what the current state wants, in one pass */
+static void apply(void) {
+  const char *want;
+  Target *t;
+  int n = 0;
+
+  for (t = targets; t < targets + ntargets; t++) {
+    if (t->broken) continue;
+    if (!(want = wanted(t))) {
+      /* nothing to give back if it was never touched */
+      if (!t->known) continue;
+      want = t->saved;
+    }
+    if (!t->known) {
+      if (read_attr(t->path, t->saved, sizeof(t->saved)) < 0) {
+        printf("Power policy: can't read %s\n", t->path);
+        t->broken = 1;
+        continue;
+      }
+      strcpy(t->written, t->saved);
+      t->known = 1;
+    }
+    if (strcmp(want, t->written)) n += write_value(t, want);
+  }
+  printf("Power policy %s%s, %d file%s changed\n",
+         state_names[base], hot ? "+hot" : "", n, n == 1 ? "" : "s");
+}
+
+
+void policy_update(int ac, const double *in) {
+  double  total = in[IN_TOTAL], temp = in[IN_TEMP];
+  int     next, next_hot, i;
+
+  if (!nrules) return;
+  /* a low state is only left POLICY_HYST past its level */
+  if (ac)
+    next = ST_AC;
+  else if (isnan(total))
+    next = ST_BATTERY;
+  else if (total < critical_level || (base == ST_CRITICAL && total < critical_level + POLICY_HYST))
+    next = ST_CRITICAL;
+  else if (total < low_level || ((base == ST_LOW || base == ST_CRITICAL) && total < low_level + POLICY_HYST))
+    next = ST_LOW;
+  else
+    next = ST_BATTERY;
+  next_hot = !isnan(temp) && (temp > hot_level || (hot && temp > hot_level - POLICY_HYST));
+
+  if (next == base && next_hot == hot && !fresh) return;
+  fresh = 0;
+  base = next;
+  hot = next_hot;
+  /* CPUs brought online since the last change have files of their own */
+  for (i = 0; i < nrules; i++) expand(i);
+  apply();
+}
+
+
+void policy_restore(void) {
+  Target *t;
+  int n = 0;
+
+  for (t = targets; t < targets + ntargets; t++)
+    if (t->known && !t->broken && strcmp(t->written, t->saved)) n += write_value(t, t->saved);
+  if (n) printf("Power policy: %d file%s restored\n", n, n == 1 ? "" : "s");
+}
+
+
+int policy_uses_temp(void) {
+  int i;
+
+  for (i = 0; i < nrules; i++)
+    if (rules[i].state == ST_HOT) return 1;
+  return 0;
+}
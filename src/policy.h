@@ -0,0 +1,54 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef POLICY_H
+#define POLICY_H
+
+/*
+ * Power policy, one 'policy' line of the config file per sysfs write:
+ *
+ *   policy = <state> <file> <value>
+ *
+ * States are ac, battery, low (below the alarm level), critical (below
+ * the critical level) and hot (above the alarm temperature, on top of
+ * the others, its lines win). <file> may be a glob pattern and is taken
+ * below policy_root, so a fake sysfs tree can stand in for /sys. On a
+ * change of state every file gets the value of the last line of that
+ * state naming it, where critical without one falls back to low and low
+ * to battery, or else its value from before wmbatteries touched it, all
+ * in one pass that skips what is already set. The patterns are
+ * matched again on every change of state, so a file that appears later,
+ * like that of a CPU brought online, gets its value with the next change
+ * and not before. The old values are written back on exit. In a dry run
+ * the writes are only logged.
+ */
+
+/* OPT_CUSTOM parser for the policy lines, collected until policy_commit() */
+int  policy_parse_rule(const char *value);
+void policy_begin(void);
+/*
+ * Takes over the collected lines and thresholds, returns 1 if anything
+ * differs from before. Changed lines first restore the old values.
+ */
+int  policy_commit(const char *root, int dry_run, int low, int critical, int hot);
+/* feeds the AC state and alarm inputs (see alarm.h) of a new sample */
+void policy_update(int ac, const double *in);
+/* whether the hot state has lines, which makes it need the temperature */
+int  policy_uses_temp(void);
+/* writes back what the policy changed */
+void policy_restore(void);
+
+#endif	/* ifndef POLICY_H */
@@ -0,0 +1,245 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+#include "procs.h"
+#include "wmbatteries.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+
+#define MAX_PROCS   2048        /* hash slots, a power of two */
+
+typedef struct Entry {
+  int                 pid;      /* 0 if the slot is free */
+  unsigned            pass;     /* last pass that saw it */
+  unsigned long long  start;    /* start time, tells a reused pid */
+  unsigned long       ticks;    /* utime + stime */
+  long                at;       /* msec of the last read */
+  double              share;    /* of all CPUs between the last two reads */
+  unsigned long long  io;       /* read_bytes + write_bytes */
+  long                io_at;    /* 0 if io is not known */
+  long                io_rate;
+  char                comm[16];
+} Entry;
+
+static Entry  table[MAX_PROCS];
+static Entry  spare[MAX_PROCS];
+static int    nentries;
+static DIR    *proc;
+static unsigned pass = 1;
+static int    scan;
+static long   power;            /* uW of the last sample */
+static long   hz;
+static long   ncpu;
+static Proc   top[PROCS_TOP];
+static double top_share[PROCS_TOP];
+static int    ntop;
+static int    last_count;       /* processes in the last pass */
+static long   last_took;        /* msec the last pass took */
+static long   pass_start;
+
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+static Entry *lookup(Entry *t, int pid, int add) {
+  unsigned i = (unsigned)pid * 2654435761u & (MAX_PROCS - 1);
+
+  while (t[i].pid && t[i].pid != pid) i = (i + 1) & (MAX_PROCS - 1);
+  if (t[i].pid) return &t[i];
+  /* keep a quarter free so the probes stay short */
+  if (!add || nentries >= MAX_PROCS * 3 / 4) return NULL;
+  memset(&t[i], 0, sizeof(Entry));
+  t[i].pid = pid;
+  nentries++;
+  return &t[i];
+}
+
+
+/* reads a small /proc file relative to the open /proc directory */
+static int read_proc(int pid, const char *file, char *buf, int size) {
+  char  path[32];
+  int   fd, n;
+
+  snprintf(path, sizeof(path), "%d/%s", pid, file);
+  if ((fd = openat(dirfd(proc), path, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+  n = read(fd, buf, size - 1);
+  close(fd);
+  if (n <= 0) return -1;
+  buf[n] = '\0';
+  return n;
+}
+
+
+static void read_stat(int pid, long now) {
+  unsigned long       utime, stime;
+  unsigned long long  start;
+  char  buf[512], *open, *close;
+  Entry *e;
+  long  dt;
+
+  if (read_proc(pid, "stat", buf, sizeof(buf)) < 0) return;
+  /* the name may hold anything, parentheses and spaces too */
+  if (!(open = strchr(buf, '(')) || !(close = strrchr(buf, ')'))) return;
+  if (sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu "
+             "%*d %*d %*d %*d %*d %*d %llu", &utime, &stime, &start) != 3) return;
+  if (!(e = lookup(table, pid, 1))) return;
+
+  if (e->pass && e->start == start && (dt = now - e->at) > 0)
+    e->share = (double)(utime + stime - e->ticks) * 1000 / (dt * hz * ncpu);
+  else {
+    /* new, or the pid was reused */
+    e->share = 0;
+    e->io_at = 0;
+  }
+  e->start = start;
+  e->ticks = utime + stime;
+  e->at = now;
+  e->pass = pass;
+  snprintf(e->comm, sizeof(e->comm), "%.*s", (int)(close - open - 1), open + 1);
+}
+
+
+static void read_io(Entry *e, long now) {
+  unsigned long long  rd = 0, wr = 0;
+  char  buf[512], *p;
+
+  e->io_rate = -1;
+  /* only readable for our own processes, or as root */
+  if (read_proc(e->pid, "io", buf, sizeof(buf)) < 0) return;
+  if ((p = strstr(buf, "\nread_bytes:"))) rd = strtoull(p + 12, NULL, 10);
+  if ((p = strstr(buf, "\nwrite_bytes:"))) wr = strtoull(p + 13, NULL, 10);
+  if (e->io_at && now > e->io_at) e->io_rate = (rd + wr - e->io) * 1000 / (now - e->io_at);
+  e->io = rd + wr;
+  e->io_at = now;
+}
+
+
+/* drops the processes the pass did not see and picks the top */
+static void end_pass(long now) {
+  Entry *e, *ranked[PROCS_TOP];
+  int   i, n = 0;
+
+  memcpy(spare, table, sizeof(table));
+  memset(table, 0, sizeof(table));
+  nentries = 0;
+  for (e = spare; e < spare + MAX_PROCS; e++)
+    if (e->pid && e->pass == pass) *lookup(table, e->pid, 1) = *e;
+
+  for (e = table; e < table + MAX_PROCS; e++) {
+    if (!e->pid || e->share <= 0) continue;
+    for (i = n; i > 0 && ranked[i - 1]->share < e->share; i--)
+      if (i < PROCS_TOP) ranked[i] = ranked[i - 1];
+    if (i < PROCS_TOP) {
+      ranked[i] = e;
+      if (n < PROCS_TOP) n++;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    read_io(ranked[i], now);
+    top[i].pid = ranked[i]->pid;
+    strcpy(top[i].comm, ranked[i]->comm);
+    top[i].cpu = ranked[i]->share * 1000;
+    top[i].io = ranked[i]->io_rate;
+    top_share[i] = ranked[i]->share;
+  }
+  ntop = n;
+  last_count = nentries;
+  last_took = now - pass_start;
+  pass_start = now;
+  pass++;
+}
+
+
+void procs_configure(int n) {
+  scan = n;
+  if (!scan && proc) {
+    closedir(proc);
+    proc = NULL;
+    memset(table, 0, sizeof(table));
+    nentries = ntop = 0;
+  }
+}
+
+
+int procs_update(long uw) {
+  struct dirent *de;
+  long  now;
+  int   n = 0;
+
+  power = uw;
+  if (!scan) return 0;
+  if (!proc) {
+    if (!(proc = opendir("/proc"))) {
+      printf("Can't read /proc, no process view\n");
+      scan = 0;
+      return 0;
+    }
+    hz = sysconf(_SC_CLK_TCK);
+    if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1) ncpu = 1;
+    pass_start = now_ms();
+  }
+  now = now_ms();
+  while (n < scan) {
+    if (!(de = readdir(proc))) {
+      end_pass(now);
+      rewinddir(proc);
+      return 1;
+    }
+    if (!isdigit((unsigned char)de->d_name[0])) continue;
+    read_stat(atoi(de->d_name), now);
+    n++;
+  }
+  return 0;
+}
+
+
+int procs_get(int k, Proc *p) {
+  if (k < 0 || k >= ntop) return -1;
+  *p = top[k];
+  p->mw = power * top_share[k] / 1000;
+  return 0;
+}
+
+
+void procs_print(FILE *out) {
+  Proc  p;
+  int   k;
+
+  if (!scan) return;
+  fprintf(out, "Power by process (%d processes, pass of %ld msec):\n", last_count, last_took);
+  for (k = 0; procs_get(k, &p) == 0; k++) {
+    fprintf(out, "  %7d %-15s %6ld mW %5.1f%% CPU", p.pid, p.comm, p.mw, p.cpu / 10.0);
+    if (p.io >= 0) fprintf(out, " %8ld B/s I/O", p.io);
+    fputc('\n', out);
+  }
+}
@@ -0,0 +1,49 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef PROCS_H
+#define PROCS_H
+
+#include <stdio.h>
+
+/*
+ * Which processes the power goes to. Every sample reads the stat file of
+ * the next few /proc entries, so a pass over all processes takes several
+ * samples and never more than procs_scan reads at once. The CPU time a
+ * process used between two passes, as a share of all CPUs, gets the same
+ * share of the power measured last; the idle rest is not attributed. At
+ * the end of a pass the PROCS_TOP biggest consumers are kept and their
+ * I/O counters read, where /proc lets us.
+ */
+#define PROCS_TOP   5
+
+typedef struct Proc {
+  int         pid;
+  char        comm[16];
+  long        mw;             /* attributed power, mW (or mA) */
+  int         cpu;            /* permille of all CPUs */
+  long        io;             /* bytes per second, -1 if unknown */
+} Proc;
+
+/* stat files read per sample, 0 turns the scan off */
+void procs_configure(int scan);
+/* a sample with the power in uW (or uA), returns 1 if the top changed */
+int  procs_update(long power);
+/* the k-th biggest consumer, -1 if there is none */
+int  procs_get(int k, Proc *p);
+void procs_print(FILE *out);
+
+#endif	/* ifndef PROCS_H */
@@ -0,0 +1,261 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "sampler.h"
+#include "dockapp.h"
+#include "defaults.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef __linux
+# include <sys/eventfd.h>
+#endif
+
+#define STALE_SKIP  12    /* samples a stale source sits out before a retry */
+#define FRESH       4     /* set in 'middle' until the event loop took it */
+#define MAX_JOBS    4
+
+static AcpiInfos  *work;          /* only touched by the sampler thread */
+static sampler_read_fn read_fn;
+static void       (*ready_cb)(const AcpiInfos *infos, int changed);
+static int        req_fd = -1;
+static int        done_fd = -1;
+static int        running;        /* the thread has been started */
+
+/* jobs for the thread, the lock is never held across a read or a job */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static void       (*jobs[MAX_JOBS])(void);
+static int        njobs;
+static int        in_jobs;        /* the thread is running its jobs */
+static unsigned   timeout_ms = SAMPLE_TIMEOUT;
+
+/*
+ * Triple buffer: the thread fills slots[back] and swaps it with the
+ * middle one, the event loop swaps the middle one with slots[front].
+ * Only 'middle' is shared, and only through atomic exchanges.
+ */
+static AcpiInfos  slots[3];
+static int        back = 0;
+static int        middle = 1;
+static int        front = 2;
+static int        pending;        /* sticky 'changed' of unread samples */
+
+static unsigned   stale_mask;     /* STALE_* bits, atomic */
+static unsigned   busy_source;    /* sources being read, 0 if none */
+static long       busy_since;     /* msec, when the first of them started */
+static unsigned   reported;       /* stale bits already logged, loop only */
+static int        skip[8];
+
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+void sampler_configure(unsigned timeout) {
+  __atomic_store_n(&timeout_ms, timeout, __ATOMIC_RELAXED);
+}
+
+
+unsigned sampler_stale(void) {
+  return __atomic_load_n(&stale_mask, __ATOMIC_ACQUIRE);
+}
+
+
+int sampler_begin(unsigned source) {
+  int n = __builtin_ctz(source);
+
+  if ((sampler_stale() & source) && skip[n] > 0) {
+    skip[n]--;
+    return 0;
+  }
+  if (!__atomic_load_n(&busy_source, __ATOMIC_RELAXED))
+    __atomic_store_n(&busy_since, now_ms(), __ATOMIC_RELAXED);
+  __atomic_fetch_or(&busy_source, source, __ATOMIC_RELEASE);
+  return 1;
+}
+
+
+void sampler_end(unsigned source, long took) {
+  /* sources that were skipped or never begun are left alone */
+  if (!(__atomic_fetch_and(&busy_source, ~source, __ATOMIC_ACQ_REL) & source)) return;
+  if (took > (long)__atomic_load_n(&timeout_ms, __ATOMIC_RELAXED)) {
+    __atomic_fetch_or(&stale_mask, source, __ATOMIC_ACQ_REL);
+    skip[__builtin_ctz(source)] = STALE_SKIP;
+    DPRINTF("D: source %#x took %ld ms, marked stale\n", source, took)
+  } else if (sampler_stale() & source) {
+    __atomic_fetch_and(&stale_mask, ~source, __ATOMIC_ACQ_REL);
+  }
+}
+
+
+unsigned sampler_watchdog(void) {
+  unsigned source = __atomic_load_n(&busy_source, __ATOMIC_ACQUIRE);
+  unsigned mask;
+
+  if (source && now_ms() - __atomic_load_n(&busy_since, __ATOMIC_RELAXED) >
+                (long)__atomic_load_n(&timeout_ms, __ATOMIC_RELAXED))
+    __atomic_fetch_or(&stale_mask, source, __ATOMIC_ACQ_REL);
+  mask = sampler_stale();
+  if (mask & ~reported)
+    printf("battery source %#x stopped answering, showing old values\n", mask & ~reported);
+  if (reported & ~mask)
+    printf("battery source %#x answers again\n", reported & ~mask);
+  reported = mask;
+  return mask;
+}
+
+
+void sampler_post(void (*job)(void)) {
+  int i;
+
+  if (!running) {
+    job();
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  for (i = 0; i < njobs && jobs[i] != job; i++)
+    ;
+  if (i == njobs && njobs < MAX_JOBS) jobs[njobs++] = job;
+  pthread_mutex_unlock(&lock);
+  sampler_request();
+}
+
+
+int sampler_busy(void) {
+  int busy;
+
+  pthread_mutex_lock(&lock);
+  busy = njobs || in_jobs;
+  pthread_mutex_unlock(&lock);
+  return busy;
+}
+
+
+#ifdef __linux
+/* runs what the event loop posted since the last read */
+static void run_jobs(void) {
+  void  (*todo[MAX_JOBS])(void);
+  int   i, n;
+
+  pthread_mutex_lock(&lock);
+  n = njobs;
+  memcpy(todo, jobs, n * sizeof(todo[0]));
+  njobs = 0;
+  in_jobs = n > 0;
+  pthread_mutex_unlock(&lock);
+  if (!n) return;
+  for (i = 0; i < n; i++) todo[i]();
+  pthread_mutex_lock(&lock);
+  in_jobs = 0;
+  pthread_mutex_unlock(&lock);
+}
+
+
+static void *sampler_main(void *arg) {
+  uint64_t  n;
+  int       changed;
+
+  for (;;) {
+    if (read(req_fd, &n, sizeof(n)) != sizeof(n)) continue;
+
+    run_jobs();
+    changed = read_fn(work);
+    memcpy(&slots[back], work, sizeof(AcpiInfos));
+
+    back = __atomic_exchange_n(&middle, back | FRESH, __ATOMIC_ACQ_REL) & 3;
+    __atomic_fetch_or(&pending, changed, __ATOMIC_RELEASE);
+    n = 1;
+    if (write(done_fd, &n, sizeof(n)) < 0) {
+      DPRINTF("D: sampler can't signal the event loop\n")
+    }
+  }
+  return NULL;
+}
+
+
+static void sample_done(int fd, void *data) {
+  uint64_t  n;
+  int       changed, fresh = 0;
+
+  if (read(fd, &n, sizeof(n)) < 0) return;
+  changed = __atomic_exchange_n(&pending, 0, __ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&middle, __ATOMIC_ACQUIRE) & FRESH) {
+    front = __atomic_exchange_n(&middle, front, __ATOMIC_ACQ_REL) & 3;
+    fresh = 1;
+  }
+  if (fresh || changed) ready_cb(&slots[front], changed);
+}
+#endif
+
+
+int sampler_start(AcpiInfos *infos, sampler_read_fn read,
+                  void (*ready)(const AcpiInfos *infos, int changed)) {
+#ifdef __linux
+  pthread_t thread;
+  sigset_t  all, old;
+  int       err;
+
+  work = infos;
+  read_fn = read;
+  ready_cb = ready;
+  if ((req_fd = eventfd(0, EFD_CLOEXEC)) < 0 ||
+      (done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0 ||
+      !dockapp_watch_fd(done_fd, sample_done, NULL)) {
+    perror("eventfd");
+    return -1;
+  }
+  /* signals stay with the main thread, the launcher relies on that */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  err = pthread_create(&thread, NULL, sampler_main, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err) {
+    fprintf(stderr, "can't start the sampler thread: %s\n", strerror(err));
+    dockapp_unwatch_fd(done_fd);
+    return -1;
+  }
+  pthread_detach(thread);
+  running = 1;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+
+void sampler_request(void) {
+  uint64_t n = 1;
+
+  if (req_fd >= 0 && write(req_fd, &n, sizeof(n)) < 0) {
+    DPRINTF("D: can't wake the sampler\n")
+  }
+}
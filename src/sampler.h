@@ -0,0 +1,61 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "wmbatteries.h"
+
+/*
+ * Runs the battery reads on their own thread, so an embedded controller
+ * that takes half a second to answer does not freeze the event loop.
+ * Finished samples go through a lock-free triple buffer and an eventfd
+ * wakes the event loop, where 'ready' gets the newest one.
+ *
+ * The read function brackets every source with sampler_begin() and
+ * sampler_end(), several may be in flight at once. A source whose read
+ * takes longer than the timeout is marked stale and skipped for a while
+ * before it is tried again; the event loop's sampler_watchdog() also
+ * marks reads that hang right now.
+ */
+typedef int (*sampler_read_fn)(AcpiInfos *infos);
+
+int  sampler_start(AcpiInfos *infos, sampler_read_fn read,
+                   void (*ready)(const AcpiInfos *infos, int changed));
+void sampler_configure(unsigned timeout);
+/* asks for a sample, requests made while one is running are merged */
+void sampler_request(void);
+/*
+ * The STALE_* mask, including a source that is hanging right now. Logs
+ * a source once when it goes stale and once when it answers again.
+ */
+unsigned sampler_watchdog(void);
+unsigned sampler_stale(void);
+/*
+ * Runs 'job' on the sampler thread before its next read, or right away
+ * without a thread; the caller never waits for a read. Posting a job that
+ * is already queued does nothing.
+ */
+void sampler_post(void (*job)(void));
+/* 1 while posted jobs have not finished */
+int  sampler_busy(void);
+
+/* returns 0 if the source should be skipped this time */
+int  sampler_begin(unsigned source);
+/* 'took' is the read time in msec */
+void sampler_end(unsigned source, long took);
+
+#endif	/* ifndef SAMPLER_H */
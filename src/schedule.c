@@ -0,0 +1,78 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "schedule.h"
+#include <time.h>
+
+static long     interval[TIERS];
+static long     next[TIERS];
+static unsigned forced = ~0u;     /* the first sample reads everything */
+static long     asleep = -1;      /* msec of suspend seen so far */
+
+#define SUSPEND_MIN   1000        /* msec, shorter gaps are clock noise */
+
+
+static long clock_ms(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+
+void schedule_interval(int tier, long msec) {
+  long now = clock_ms(CLOCK_MONOTONIC);
+
+  interval[tier] = msec;
+  /* a shorter interval takes effect right away, not after the old one */
+  if (next[tier] > now + msec) next[tier] = now + msec;
+}
+
+
+void schedule_force(unsigned tiers) {
+  __atomic_fetch_or(&forced, tiers, __ATOMIC_RELEASE);
+}
+
+
+unsigned schedule_due(long slack) {
+  unsigned due = TIER(TIER_FAST) | __atomic_exchange_n(&forced, 0, __ATOMIC_ACQ_REL);
+  long now = clock_ms(CLOCK_MONOTONIC);
+  int t;
+
+  for (t = TIER_FAST + 1; t < TIERS; t++) {
+    if (now + slack >= next[t]) due |= TIER(t);
+    if (due & TIER(t)) next[t] = now + interval[t];
+  }
+  return due;
+}
+
+
+long schedule_suspended(void) {
+  long total = clock_ms(CLOCK_BOOTTIME) - clock_ms(CLOCK_MONOTONIC), slept;
+
+  if (asleep < 0) asleep = total;
+  if ((slept = total - asleep) < SUSPEND_MIN) return 0;
+  asleep = total;
+  return slept;
+}
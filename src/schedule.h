@@ -0,0 +1,42 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+/*
+ * How often each tier of sources is read. The fast tier (AC, battery
+ * status, power and charge) goes with every sample; the slower tiers
+ * become due when their interval has passed, and are then read along with
+ * the next fast sample so that one wakeup and one read batch serve all of
+ * them. Static values are read by init_stats() at startup and hot-plug.
+ */
+enum { TIER_FAST, TIER_THERMAL, TIER_CAPACITY, TIERS };
+
+#define TIER(t)   (1u << (t))
+
+void     schedule_interval(int tier, long msec);
+/* makes the tiers due on the next sample, from any thread */
+void     schedule_force(unsigned tiers);
+/* the TIER() mask to read now; a tier due within 'slack' msec is included */
+unsigned schedule_due(long slack);
+/*
+ * msec the system spent suspended since the last call, 0 if it did not;
+ * CLOCK_BOOTTIME runs on in suspend, CLOCK_MONOTONIC does not
+ */
+long     schedule_suspended(void);
+
+#endif	/* ifndef SCHEDULE_H */
@@ -0,0 +1,252 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "server.h"
+#include "dockapp.h"
+#include "latency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_CLIENTS 16
+#define INBUF_LEN   64
+#define OUTBUF_LEN  8192    /* room for the latency tables */
+#define STATE_LEN   512
+
+typedef struct Client {
+  int   fd;
+  int   subscribed;
+  int   inlen;
+  char  in[INBUF_LEN];
+  int   outlen;
+  char  out[OUTBUF_LEN];
+} Client;
+
+static int    listen_fd = -1;
+static char   sock_path[108];
+static Client clients[MAX_CLIENTS];
+static char   state[STATE_LEN] = "{}\n";
+static int    state_len = 3;
+
+static void accept_client(int fd, void *data);
+static void read_client(int fd, void *data);
+
+
+static int set_nonblock(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return -1;
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return 0;
+}
+
+
+int server_open(const char *path) {
+  struct sockaddr_un addr;
+  int i;
+
+  if (path == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket path too long\n");
+    return -1;
+  }
+  for (i = 0; i < MAX_CLIENTS; i++) clients[i].fd = -1;
+
+  if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    perror("socket");
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listen_fd, MAX_CLIENTS) < 0 || set_nonblock(listen_fd) < 0) {
+    fprintf(stderr, "can't listen on '%s': %s\n", path, strerror(errno));
+    close(listen_fd);
+    listen_fd = -1;
+    return -1;
+  }
+  strcpy(sock_path, path);
+  dockapp_watch_fd(listen_fd, accept_client, NULL);
+  DPRINTF("D: listening on '%s'\n", path)
+  return 0;
+}
+
+
+void server_close(void) {
+  int i;
+
+  if (listen_fd < 0) return;
+  for (i = 0; i < MAX_CLIENTS; i++) {
+    if (clients[i].fd >= 0) {
+      dockapp_unwatch_fd(clients[i].fd);
+      close(clients[i].fd);
+      clients[i].fd = -1;
+    }
+  }
+  dockapp_unwatch_fd(listen_fd);
+  close(listen_fd);
+  unlink(sock_path);
+  listen_fd = -1;
+}
+
+
+static void drop_client(Client *c) {
+  dockapp_unwatch_fd(c->fd);
+  close(c->fd);
+  c->fd = -1;
+}
+
+
+/* push as much of the pending output as the socket takes without blocking */
+static int flush_client(Client *c) {
+  ssize_t n;
+
+  while (c->outlen > 0) {
+    n = send(c->fd, c->out, c->outlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      return -1;
+    }
+    memmove(c->out, c->out + n, c->outlen - n);
+    c->outlen -= n;
+  }
+  return 0;
+}
+
+
+static void queue_client(Client *c, const char *msg, int len) {
+  if (c->outlen + len > OUTBUF_LEN) {
+    /* client is not reading, don't let it pile up memory or stall us */
+    DPRINTF("D: dropping slow socket client %d\n", c->fd)
+    drop_client(c);
+    return;
+  }
+  memcpy(c->out + c->outlen, msg, len);
+  c->outlen += len;
+  if (flush_client(c) < 0) drop_client(c);
+}
+
+
+static void accept_client(int fd, void *data) {
+  int cfd, i;
+
+  while ((cfd = accept(fd, NULL, NULL)) >= 0) {
+    for (i = 0; i < MAX_CLIENTS && clients[i].fd >= 0; i++);
+    if (i == MAX_CLIENTS || set_nonblock(cfd) < 0 ||
+        !dockapp_watch_fd(cfd, read_client, &clients[i])) {
+      close(cfd);
+      continue;
+    }
+    clients[i].fd = cfd;
+    clients[i].subscribed = 0;
+    clients[i].inlen = 0;
+    clients[i].outlen = 0;
+  }
+}
+
+
+static void handle_command(Client *c, char *cmd) {
+  static const char err[] = "{\"error\":\"unknown command\"}\n";
+  char  buf[OUTBUF_LEN];
+  int   len;
+
+  if (!strcmp(cmd, "get")) {
+    queue_client(c, state, state_len);
+  } else if (!strcmp(cmd, "subscribe")) {
+    c->subscribed = 1;
+    queue_client(c, state, state_len);
+  } else if (!strcmp(cmd, "latency")) {
+    if ((len = latency_json(buf, sizeof(buf))) > 0) queue_client(c, buf, len);
+  } else if (!strcmp(cmd, "quit")) {
+    drop_client(c);
+  } else if (cmd[0]) {
+    queue_client(c, err, sizeof(err) - 1);
+  }
+}
+
+
+static void read_client(int fd, void *data) {
+  Client  *c = data;
+  ssize_t n;
+  char    *nl;
+
+  n = recv(fd, c->in + c->inlen, INBUF_LEN - c->inlen, MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+    drop_client(c);
+    return;
+  }
+  if (n < 0) return;
+  c->inlen += n;
+
+  while (c->fd >= 0 && (nl = memchr(c->in, '\n', c->inlen))) {
+    *nl = '\0';
+    if (nl > c->in && nl[-1] == '\r') nl[-1] = '\0';
+    handle_command(c, c->in);
+    c->inlen -= nl + 1 - c->in;
+    memmove(c->in, nl + 1, c->inlen);
+  }
+  if (c->fd >= 0 && c->inlen == INBUF_LEN) drop_client(c);
+  else if (c->fd >= 0 && flush_client(c) < 0) drop_client(c);
+}
+
+
+static const char *status_name(int status) {
+  switch (status) {
+    case CHARGING:    return "charging";
+    case DISCHARGING: return "discharging";
+    default:          return "unknown";
+  }
+}
+
+
+/* called after every sample that changed something */
+void server_update(const AcpiInfos *infos, int nbat) {
+  int bat, i;
+
+  if (listen_fd < 0) return;
+
+  state_len = snprintf(state, STATE_LEN,
+      "{\"ac\":%d,\"temp\":%.1f,\"low\":%d,\"time_left\":%d,\"stale\":%u,\"batteries\":[",
+      infos->ac_line_status, infos->thermal_temp / 10.0, infos->low,
+      infos->hours_left * 60 + infos->minutes_left, infos->stale);
+  for (bat = 0; bat < nbat; bat++) {
+    state_len += snprintf(state + state_len, STATE_LEN - state_len,
+        "%s{\"status\":\"%s\",\"percentage\":%d,\"rate\":%ld,"
+        "\"remain\":%ld,\"capacity\":%ld}",
+        bat ? "," : "", status_name(infos->battery_status[bat]),
+        infos->battery_percentage[bat], infos->rate[bat],
+        infos->remain[bat], infos->currcap[bat]);
+  }
+  state_len += snprintf(state + state_len, STATE_LEN - state_len, "]}\n");
+
+  for (i = 0; i < MAX_CLIENTS; i++)
+    if (clients[i].fd >= 0 && clients[i].subscribed)
+      queue_client(&clients[i], state, state_len);
+}
@@ -0,0 +1,35 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "wmbatteries.h"
+
+/*
+ * Local query socket. Clients connect to a unix stream socket and send
+ * line based commands:
+ *   get        - reply with one JSON object describing the current state
+ *   subscribe  - reply now and again every time the state changes
+ *   latency    - reply with the read latency histograms, see latency.h
+ *   quit       - close the connection
+ * All sockets are non-blocking; a client that does not drain its replies
+ * is disconnected rather than stalling the dockapp.
+ */
+int  server_open(const char *path);
+void server_update(const AcpiInfos *infos, int nbat);
+void server_close(void);
+
+#endif	/* ifndef SERVER_H */
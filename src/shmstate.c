@@ -0,0 +1,117 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "shmstate.h"
+#include "wmbatteries_shm.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+static WmbShm *shm = NULL;
+static char   shm_name[256];
+
+
+int shmstate_open(const char *name) {
+  uint32_t seq;
+  int fd;
+
+  if (strlen(name) >= sizeof(shm_name)) {
+    fprintf(stderr, "shared memory name too long\n");
+    return -1;
+  }
+  /* the samples are the user's business; a stale segment keeps its mode */
+  if ((fd = shm_open(name, O_RDWR | O_CREAT, 0600)) < 0 || fchmod(fd, 0600) < 0) {
+    fprintf(stderr, "shm_open(%s): %s\n", name, strerror(errno));
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  if (ftruncate(fd, sizeof(WmbShm)) < 0) {
+    fprintf(stderr, "ftruncate(%s): %s\n", name, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  shm = mmap(NULL, sizeof(WmbShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED) {
+    fprintf(stderr, "mmap(%s): %s\n", name, strerror(errno));
+    shm = NULL;
+    return -1;
+  }
+  strcpy(shm_name, name);
+
+  /* a stale segment may be left over from a killed instance, possibly
+   * with an odd sequence count: continue counting from there */
+  seq = (shm->seq + 1) & ~1U;
+  __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memset(&shm->sample, 0, sizeof(shm->sample));
+  shm->magic = WMB_SHM_MAGIC;
+  shm->version = WMB_SHM_VERSION;
+  __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+  DPRINTF("D: publishing state in shared memory '%s'\n", name)
+  return 0;
+}
+
+
+void shmstate_close(void) {
+  if (!shm) return;
+  munmap(shm, sizeof(WmbShm));
+  shm_unlink(shm_name);
+  shm = NULL;
+}
+
+
+/* called after every sample */
+void shmstate_update(const AcpiInfos *infos, int nbat) {
+  WmbShmSample *s;
+  struct timespec ts;
+  uint32_t seq;
+  int bat;
+
+  if (!shm) return;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  seq = shm->seq;
+  __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  s = &shm->sample;
+  s->generation++;
+  s->timestamp_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  s->ac_online = infos->ac_line_status;
+  s->temp = infos->thermal_temp;
+  s->low = infos->low;
+  s->time_left = infos->hours_left * 60 + infos->minutes_left;
+  s->nbat = nbat;
+  for (bat = 0; bat < WMB_SHM_MAXBAT; bat++) {
+    s->bat[bat].status = bat < nbat ? infos->battery_status[bat] : WMB_SHM_UNKNOWN;
+    s->bat[bat].percentage = bat < nbat ? infos->battery_percentage[bat] : 0;
+    s->bat[bat].rate = bat < nbat ? infos->rate[bat] : 0;
+    s->bat[bat].remain = bat < nbat ? infos->remain[bat] : 0;
+    s->bat[bat].capacity = bat < nbat ? infos->currcap[bat] : 0;
+  }
+
+  __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
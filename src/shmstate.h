@@ -0,0 +1,26 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifndef SHMSTATE_H
+#define SHMSTATE_H
+
+#include "wmbatteries.h"
+
+/* writer side of the shared memory segment, see wmbatteries_shm.h */
+int  shmstate_open(const char *name);
+void shmstate_update(const AcpiInfos *infos, int nbat);
+void shmstate_close(void);
+
+#endif	/* ifndef SHMSTATE_H */
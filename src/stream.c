@@ -0,0 +1,169 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define LINE_LEN 512
+
+static int  out_fd = STDOUT_FILENO;
+static const char *tmpl = STREAM_TEMPLATE;
+static int  json = 0;
+static int  single = 0;
+static int  started = 0;
+static char last[LINE_LEN];
+static int  last_len = -1;
+
+
+void stream_claim_stdout(void) {
+  int fd;
+
+  if (out_fd != STDOUT_FILENO) return;
+  if ((fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3)) < 0) return;
+  out_fd = fd;
+  dup2(STDERR_FILENO, STDOUT_FILENO);
+}
+
+
+void stream_open(const char *format, int once) {
+  single = once;
+  if (format == NULL) return;
+  if (!strncmp(format, "json", 4) && (format[4] == '\0' || format[4] == ':')) {
+    json = 1;
+    if (format[4] == ':') tmpl = format + 5;
+  } else {
+    tmpl = format;
+  }
+}
+
+
+int stream_wants_temp(void) {
+  return strstr(tmpl, "%T") != NULL;
+}
+
+
+static const char *status_word(const AcpiInfos *k, int nbat) {
+  int bat;
+
+  for (bat = 0; bat < nbat; bat++)
+    if (k->battery_status[bat] == CHARGING) return "charging";
+  for (bat = 0; bat < nbat; bat++)
+    if (k->battery_status[bat] == DISCHARGING) return "discharging";
+  return k->ac_line_status == 1 ? "ac" : "unknown";
+}
+
+
+/* expands the template, escaping for a JSON string if needed */
+static int expand(char *out, int len, const AcpiInfos *k, int nbat) {
+  char  val[32];
+  const char *p, *v;
+  long  remain = 0, cap = 0, rate = 0;
+  int   bat, n = 0;
+
+  for (bat = 0; bat < nbat; bat++) {
+    remain += k->remain[bat];
+    cap += k->currcap[bat];
+    rate += k->rate[bat];
+  }
+
+  for (p = tmpl; *p && n < len - 2; p++) {
+    v = val;
+    if (*p != '%' || !p[1]) {
+      val[0] = *p;
+      val[1] = '\0';
+    } else {
+      switch (*++p) {
+      case 'p': snprintf(val, sizeof(val), "%ld", cap > 0 ? remain * 100 / cap : 0); break;
+      case '0':
+      case '1':
+        bat = *p - '0';
+        snprintf(val, sizeof(val), "%d", bat < nbat ? k->battery_percentage[bat] : 0);
+        break;
+      case 's': v = status_word(k, nbat); break;
+      case 't':
+        if (k->hours_left || k->minutes_left)
+          snprintf(val, sizeof(val), "%d:%02d", k->hours_left, k->minutes_left);
+        else
+          strcpy(val, "--:--");
+        break;
+      case 'T': snprintf(val, sizeof(val), "%d", k->thermal_temp / 10); break;
+      case 'r': snprintf(val, sizeof(val), "%ld.%ld", rate / 1000000, rate / 100000 % 10); break;
+      case 'a': snprintf(val, sizeof(val), "%d", k->ac_line_status == 1); break;
+      default:  val[0] = *p; val[1] = '\0'; break;
+      }
+    }
+    for (; *v && n < len - 2; v++) {
+      if (json && (*v == '"' || *v == '\\')) out[n++] = '\\';
+      out[n++] = *v;
+    }
+  }
+  out[n] = '\0';
+  return n;
+}
+
+
+static void write_all(const char *buf, int len) {
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(out_fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      /* the bar went away */
+      exit(errno == EPIPE ? 0 : 1);
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+
+int stream_emit(const AcpiInfos *k, int nbat) {
+  char  text[LINE_LEN / 2];
+  char  line[LINE_LEN];
+  int   len;
+
+  expand(text, sizeof(text), k, nbat);
+  if (!json)
+    len = snprintf(line, sizeof(line), "%s\n", text);
+  else
+    len = snprintf(line, sizeof(line),
+        "%s{\"name\":\"battery\",\"full_text\":\"%s\"%s}%s\n",
+        single ? "" : "[", text, k->low ? ",\"urgent\":true" : "",
+        single ? "" : "],");
+  if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+  if (len == last_len && !memcmp(line, last, len)) return 0;
+
+  if (json && !single && !started)
+    write_all("{\"version\":1}\n[\n", 16);
+  started = 1;
+  write_all(line, len);
+  memcpy(last, line, len);
+  last_len = len;
+  return 1;
+}
@@ -0,0 +1,42 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "wmbatteries.h"
+
+/*
+ * Status line output for bars like i3bar, polybar or tmux. The format is
+ * a template with these conversions:
+ *   %p  total charge in percent       %0 %1  charge of battery 0/1
+ *   %s  charging/discharging/ac/unknown
+ *   %t  time left as h:mm              %T  temperature in degrees C
+ *   %r  power draw in W                %a  1 on AC power, else 0
+ *   %%  a literal %
+ * "json" or "json:<template>" speaks the i3bar protocol instead.
+ */
+#define STREAM_TEMPLATE "%p%% %s %t"
+
+/* moves stdout aside for the status lines, diagnostics go to stderr */
+void stream_claim_stdout(void);
+void stream_open(const char *format, int once);
+/* 1 if the template shows the temperature */
+int  stream_wants_temp(void);
+/* writes a line if it differs from the last one, returns 1 if written */
+int  stream_emit(const AcpiInfos *infos, int nbat);
+
+#endif	/* ifndef STREAM_H */
@@ -0,0 +1,50 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "sysread.h"
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+
+static long elapsed_us(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+
+void sysread_batch(SysRead *reads, int n) {
+  struct timespec start;
+  SysRead *r;
+  int     res;
+
+  for (r = reads; r < reads + n; r++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    res = pread(r->fd, r->buf, r->size - 1, 0);
+    r->len = res < 0 ? -errno : res;
+    r->usec = elapsed_us(&start);
+    r->buf[res > 0 ? res : 0] = '\0';
+  }
+}
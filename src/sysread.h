@@ -0,0 +1,36 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef SYSREAD_H
+#define SYSREAD_H
+
+/*
+ * Reads a set of pre-opened sysfs files from offset 0, one pread() each,
+ * timing every read by itself. An io_uring batch saves the system calls
+ * but took longer per sample on sysfs, see tests/readbench.
+ */
+typedef struct SysRead {
+  int       fd;
+  char      *buf;
+  int       size;       /* buf is NUL terminated, so size-1 bytes are read */
+  unsigned  tag;        /* for the caller */
+  int       len;        /* bytes read, or -errno */
+  long      usec;       /* time the read took */
+} SysRead;
+
+void sysread_batch(SysRead *reads, int n);
+
+#endif	/* ifndef SYSREAD_H */
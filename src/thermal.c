@@ -0,0 +1,227 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "thermal.h"
+#include "wmbatteries.h"
+#include "latency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#define THERMAL_ZONES "/sys/class/thermal"
+#define HWMON_DIR     "/sys/class/hwmon"
+#define SLOW_READ_US  2000    /* reads slower than this are ... */
+#define SLOW_TICKS    6       /* ... only done every SLOW_TICKS samples */
+
+enum { POLICY_MAX, POLICY_AVG, POLICY_NAMED };
+
+typedef struct Source {
+  int   fd;
+  char  name[64];             /* zone type, or hwmon name[:label] */
+  int   value;                /* last reading, millidegrees */
+  int   valid;
+  int   slow;
+  int   countdown;
+  int   lat;                  /* latency histogram */
+  char  buf[32];
+} Source;
+
+static Source sources[THERMAL_MAX_SOURCES];
+static int    nsources = 0;
+static int    policy = POLICY_MAX;
+
+
+/* reads a short sysfs attribute into buf, stripping the newline */
+static int read_attr(const char *path, char *buf, int len) {
+  int fd, n;
+
+  if ((fd = open(path, O_RDONLY)) < 0) return -1;
+  n = read(fd, buf, len - 1);
+  close(fd);
+  if (n <= 0) return -1;
+  buf[n] = '\0';
+  buf[strcspn(buf, "\n")] = '\0';
+  return 0;
+}
+
+
+static int seen_name(const char *name) {
+  int i;
+
+  for (i = 0; i < nsources; i++)
+    if (!strcmp(sources[i].name, name)) return 1;
+  return 0;
+}
+
+
+static void add_source(const char *path, const char *name, const char *want) {
+  Source *s;
+  int fd;
+
+  if (nsources == THERMAL_MAX_SOURCES) return;
+  if (want && strcmp(name, want)) return;
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return;
+  s = &sources[nsources++];
+  memset(s, 0, sizeof(*s));
+  s->fd = fd;
+  s->lat = latency_source(path);
+  snprintf(s->name, sizeof(s->name), "%s", name);
+  DPRINTF("D: temperature source '%s' (%s)\n", s->name, path)
+}
+
+
+static void scan_zones(const char *want) {
+  char  path[600], type[64];
+  struct dirent *de;
+  DIR   *dir;
+
+  if (!((dir = opendir(THERMAL_ZONES)))) return;
+  while ((de = readdir(dir))) {
+    if (strncmp(de->d_name, "thermal_zone", 12)) continue;
+    snprintf(path, sizeof(path), THERMAL_ZONES "/%s/type", de->d_name);
+    if (read_attr(path, type, sizeof(type)) < 0) strcpy(type, de->d_name);
+    snprintf(path, sizeof(path), THERMAL_ZONES "/%s/temp", de->d_name);
+    add_source(path, type, want);
+  }
+  closedir(dir);
+}
+
+
+static void scan_hwmon(const char *want, int nzones) {
+  char  path[600], hwname[32], label[32], name[64];
+  struct dirent *de, *te;
+  DIR   *dir, *hdir;
+  int   i, dup;
+
+  if (!((dir = opendir(HWMON_DIR)))) return;
+  while ((de = readdir(dir))) {
+    if (de->d_name[0] == '.') continue;
+    snprintf(path, sizeof(path), HWMON_DIR "/%s/name", de->d_name);
+    if (read_attr(path, hwname, sizeof(hwname)) < 0) continue;
+    /* thermal zones register a hwmon device named after their type */
+    for (i = dup = 0; i < nzones; i++)
+      if (!strcmp(sources[i].name, hwname)) dup = 1;
+    if (dup) continue;
+
+    snprintf(path, sizeof(path), HWMON_DIR "/%s", de->d_name);
+    if (!((hdir = opendir(path)))) continue;
+    while ((te = readdir(hdir))) {
+      int len = strlen(te->d_name);
+      if (strncmp(te->d_name, "temp", 4) || len < 11 ||
+          strcmp(te->d_name + len - 6, "_input")) continue;
+      snprintf(path, sizeof(path), HWMON_DIR "/%s/%.*slabel", de->d_name, len - 5, te->d_name);
+      if (read_attr(path, label, sizeof(label)) < 0)
+        snprintf(label, sizeof(label), "%.*s", len - 6, te->d_name);
+      snprintf(name, sizeof(name), "%s:%s", hwname, label);
+      snprintf(path, sizeof(path), HWMON_DIR "/%s/%s", de->d_name, te->d_name);
+      /* a specific policy may name the device or a single sensor */
+      if (want && strcmp(want, hwname) && strcmp(want, label) && strcmp(want, name)) continue;
+      if (!seen_name(name)) add_source(path, name, NULL);
+    }
+    closedir(hdir);
+  }
+  closedir(dir);
+}
+
+
+void thermal_close(void) {
+  while (nsources > 0) close(sources[--nsources].fd);
+}
+
+
+int thermal_init(const char *pol, const char *file) {
+  const char *want = NULL;
+  int nzones;
+
+  thermal_close();
+  if (!strcmp(pol, "file")) {
+    add_source(file, "file", NULL);
+    policy = POLICY_MAX;
+  } else {
+    if (!strcmp(pol, "max")) policy = POLICY_MAX;
+    else if (!strcmp(pol, "avg")) policy = POLICY_AVG;
+    else {
+      policy = POLICY_NAMED;
+      want = pol;
+    }
+    scan_zones(want);
+    nzones = nsources;
+    scan_hwmon(want, nzones);
+  }
+  if (nsources == 0) {
+    printf("No temperature source found for '%s'\n", !strcmp(pol, "file") ? file : pol);
+    return -1;
+  }
+  return 0;
+}
+
+
+int thermal_prepare(SysRead *r, int max) {
+  Source  *s;
+  int     i, n = 0;
+
+  for (i = 0; i < nsources && n < max; i++) {
+    s = &sources[i];
+    if (s->slow && s->countdown-- > 0) continue;
+    s->countdown = SLOW_TICKS - 1;
+    r[n].fd = s->fd;
+    r[n].buf = s->buf;
+    r[n].size = sizeof(s->buf);
+    r[n].tag = i;
+    n++;
+  }
+  return n;
+}
+
+
+int thermal_finish(const SysRead *r, int n, int *temp) {
+  Source  *s;
+  long    sum = 0;
+  int     i, count = 0, best = 0;
+
+  for (i = 0; i < n; i++) {
+    s = &sources[r[i].tag];
+    latency_add(s->lat, r[i].usec);
+    if (!s->slow && r[i].usec > SLOW_READ_US) {
+      DPRINTF("D: temperature source '%s' is slow to read\n", s->name)
+      s->slow = 1;
+    }
+    s->value = r[i].len > 0 ? atoi(s->buf) : 0;
+    /* disabled or broken sensors tend to report 0 or less */
+    s->valid = s->value > 0;
+  }
+
+  for (i = 0; i < nsources; i++) {
+    s = &sources[i];
+    if (!s->valid) continue;
+    if (!count || s->value > best) best = s->value;
+    sum += s->value;
+    count++;
+  }
+  if (!count) return -1;
+  *temp = (policy == POLICY_AVG ? sum / count : best) / 100;
+  return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include "sysread.h"
+
+#define THERMAL_MAX_SOURCES 32
+
+/*
+ * Temperature sources: every thermal zone and hwmon temp*_input found at
+ * startup is opened once and re-read with pread(). The policy selects
+ * how they are combined:
+ *   max    - hottest source (default)
+ *   avg    - average of all sources
+ *   file   - only the single configured temperature file
+ *   <name> - the source whose zone type, hwmon name or label matches
+ * Sources that take long to read are only sampled every few ticks.
+ */
+int  thermal_init(const char *policy, const char *file);
+/* adds the reads due this sample to r[], returns how many */
+int  thermal_prepare(SysRead *r, int max);
+/* aggregate temperature in tenths of a degree, returns -1 if none */
+int  thermal_finish(const SysRead *r, int n, int *temp);
+void thermal_close(void);
+
+#endif	/* ifndef THERMAL_H */
@@ -0,0 +1,97 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "uevent.h"
+#include "dockapp.h"
+#include "wmbatteries.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#ifdef __linux
+# include <linux/netlink.h>
+#endif
+
+#define UEVENT_BUFFER 4096
+
+static int  uevent_fd = -1;
+static void (*uevent_cb)(int plugged);
+
+
+#ifdef __linux
+/* messages are "action@devpath" followed by NUL separated KEY=value pairs */
+static void read_uevent(int fd, void *data) {
+  char    buf[UEVENT_BUFFER];
+  char    *ptr;
+  ssize_t n;
+  int     hit = 0, plugged = 0, ours, added;
+
+  while ((n = recv(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT)) > 0) {
+    buf[n] = '\0';
+    ours = added = 0;
+    for (ptr = buf; ptr < buf + n; ptr += strlen(ptr) + 1) {
+      if (!strcmp(ptr, "SUBSYSTEM=power_supply")) ours = 1;
+      if (!strcmp(ptr, "ACTION=add") || !strcmp(ptr, "ACTION=remove")) added = 1;
+    }
+    hit |= ours;
+    plugged |= ours && added;
+  }
+  if (hit) {
+    DPRINTF("D: power_supply uevent%s\n", plugged ? ", hot-plug" : "")
+    uevent_cb(plugged);
+  }
+}
+#endif
+
+
+int uevent_open(void (*changed)(int plugged)) {
+#ifdef __linux
+  struct sockaddr_nl addr;
+  int fd;
+
+  fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+              NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = 1;   /* kernel events, not the udev rebroadcast */
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      !dockapp_watch_fd(fd, read_uevent, NULL)) {
+    close(fd);
+    return -1;
+  }
+  uevent_fd = fd;
+  uevent_cb = changed;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+
+void uevent_close(void) {
+  if (uevent_fd < 0) return;
+  dockapp_unwatch_fd(uevent_fd);
+  close(uevent_fd);
+  uevent_fd = -1;
+}
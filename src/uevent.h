@@ -0,0 +1,29 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+#ifndef UEVENT_H
+#define UEVENT_H
+
+/*
+ * Listens to kernel uevents and calls 'changed' from the main loop
+ * whenever a power_supply device (AC adapter or battery) reports a change.
+ * 'plugged' is set when one was added or removed. Returns -1 if the
+ * netlink socket can't be opened.
+ */
+int  uevent_open(void (*changed)(int plugged));
+void uevent_close(void);
+
+#endif	/* ifndef UEVENT_H */
@@ -0,0 +1,368 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef __STRICT_ANSI__
+# define _GNU_SOURCE
+#endif
+
+#include "upower.h"
+#include "dockapp.h"
+#include "wmbatteries.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef HAVE_DBUS
+/* the libdbus headers have static inline functions, -ansi has no inline */
+# if defined(__STRICT_ANSI__) && !defined(inline)
+#  define inline __inline__
+# endif
+# include <dbus/dbus.h>
+#endif
+
+#define UPOWER          "org.freedesktop.UPower"
+#define UPOWER_PATH     "/org/freedesktop/UPower"
+#define UPOWER_DEVICE   UPOWER ".Device"
+#define PROPERTIES      "org.freedesktop.DBus.Properties"
+#define UPOWER_DEVICES  8
+
+static UPowerState current;
+static int      ready;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+#ifdef HAVE_DBUS
+enum { TYPE_LINE_POWER = 1, TYPE_BATTERY = 2 };
+enum { STATE_CHARGING = 1, STATE_DISCHARGING = 2 };
+
+typedef struct Device {
+  char      path[128];
+  unsigned  type;
+  int       supply;         /* powers the machine, not a mouse */
+  int       present;
+  int       online;
+  unsigned  state;
+  double    energy, full, design, rate;   /* Wh and W */
+  unsigned  pending;        /* serial of the GetAll in flight */
+} Device;
+
+static DBusConnection *conn;
+static int      conn_fd = -1;
+static Device   devices[UPOWER_DEVICES];
+static int      ndevices;
+static unsigned enumerating;  /* serial of EnumerateDevices in flight */
+static int      rescan;       /* tell 'changed' about new devices */
+static void     (*changed_cb)(int devices);
+
+
+/* a call with no or one string argument, the serial of its reply or 0 */
+static unsigned call(const char *path, const char *iface, const char *member, const char *arg) {
+  DBusMessage   *m;
+  dbus_uint32_t serial = 0;
+
+  if (!(m = dbus_message_new_method_call(UPOWER, path, iface, member))) return 0;
+  if ((!arg || dbus_message_append_args(m, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID)) &&
+      !dbus_connection_send(conn, m, &serial)) serial = 0;
+  dbus_message_unref(m);
+  return serial;
+}
+
+
+static void enumerate(void) {
+  enumerating = call(UPOWER_PATH, UPOWER, "EnumerateDevices", NULL);
+  rescan = 1;
+}
+
+
+/* the copy upower_get() hands out, returns 1 if it changed */
+static int publish(int valid) {
+  UPowerState s;
+  Device      *d;
+  int         i, diff;
+
+  memset(&s, 0, sizeof(s));
+  for (i = 0; i < ndevices; i++) {
+    d = &devices[i];
+    if (!d->supply) continue;
+    if (d->type == TYPE_LINE_POWER && d->online) s.online = 1;
+    if (d->type != TYPE_BATTERY || !d->present || s.nbat == 2) continue;
+    s.bat[s.nbat].status = d->state == STATE_CHARGING ? CHARGING :
+                           d->state == STATE_DISCHARGING ? DISCHARGING : UNKNOWN;
+    s.bat[s.nbat].energy = d->energy * 1e6;
+    s.bat[s.nbat].full = d->full * 1e6;
+    s.bat[s.nbat].design = d->design * 1e6;
+    s.bat[s.nbat].rate = d->rate * 1e6;
+    s.nbat++;
+  }
+  pthread_mutex_lock(&lock);
+  diff = valid != ready || memcmp(&s, &current, sizeof(s));
+  current = s;
+  ready = valid;
+  pthread_mutex_unlock(&lock);
+  return diff;
+}
+
+
+static void notify(int devices) {
+  DPRINTF("D: UPower %s\n", devices ? "devices changed" : "state changed")
+  changed_cb(devices);
+}
+
+
+/* an a{sv} of device properties, what isn't known is passed over */
+static void read_properties(Device *d, DBusMessageIter *it) {
+  DBusMessageIter a, e, v;
+  const char    *name;
+  dbus_uint32_t u;
+  dbus_bool_t   b;
+  double        *num;
+
+  dbus_message_iter_recurse(it, &a);
+  for (; dbus_message_iter_get_arg_type(&a) == DBUS_TYPE_DICT_ENTRY; dbus_message_iter_next(&a)) {
+    dbus_message_iter_recurse(&a, &e);
+    dbus_message_iter_get_basic(&e, &name);
+    dbus_message_iter_next(&e);
+    dbus_message_iter_recurse(&e, &v);
+    switch (dbus_message_iter_get_arg_type(&v)) {
+    case DBUS_TYPE_DOUBLE:
+      num = !strcmp(name, "Energy") ? &d->energy :
+            !strcmp(name, "EnergyFull") ? &d->full :
+            !strcmp(name, "EnergyFullDesign") ? &d->design :
+            !strcmp(name, "EnergyRate") ? &d->rate : NULL;
+      if (num) dbus_message_iter_get_basic(&v, num);
+      break;
+    case DBUS_TYPE_UINT32:
+      dbus_message_iter_get_basic(&v, &u);
+      if (!strcmp(name, "Type")) d->type = u;
+      else if (!strcmp(name, "State")) d->state = u;
+      break;
+    case DBUS_TYPE_BOOLEAN:
+      dbus_message_iter_get_basic(&v, &b);
+      if (!strcmp(name, "PowerSupply")) d->supply = b;
+      else if (!strcmp(name, "IsPresent")) d->present = b;
+      else if (!strcmp(name, "Online")) d->online = b;
+      break;
+    }
+  }
+}
+
+
+static Device *find(const char *path) {
+  int i;
+
+  for (i = 0; path && i < ndevices; i++)
+    if (!strcmp(devices[i].path, path)) return &devices[i];
+  return NULL;
+}
+
+
+static void devices_listed(DBusMessage *m) {
+  DBusMessageIter it, a;
+  const char  *path;
+  Device      *d;
+
+  enumerating = 0;
+  if (dbus_message_get_type(m) == DBUS_MESSAGE_TYPE_ERROR || !dbus_message_has_signature(m, "ao")) {
+    printf("UPower is not available, reading sysfs\n");
+    if (publish(0)) notify(1);
+    return;
+  }
+  ndevices = 0;
+  dbus_message_iter_init(m, &it);
+  dbus_message_iter_recurse(&it, &a);
+  for (; dbus_message_iter_get_arg_type(&a) == DBUS_TYPE_OBJECT_PATH && ndevices < UPOWER_DEVICES;
+       dbus_message_iter_next(&a)) {
+    dbus_message_iter_get_basic(&a, &path);
+    if (strlen(path) >= sizeof(d->path)) continue;
+    d = &devices[ndevices++];
+    memset(d, 0, sizeof(*d));
+    strcpy(d->path, path);
+    d->pending = call(d->path, PROPERTIES, "GetAll", UPOWER_DEVICE);
+  }
+  DPRINTF("D: UPower has %d devices\n", ndevices)
+}
+
+
+static void device_read(Device *d, DBusMessage *m) {
+  DBusMessageIter it;
+  int i;
+
+  d->pending = 0;
+  if (dbus_message_get_type(m) == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+      dbus_message_has_signature(m, "a{sv}")) {
+    dbus_message_iter_init(m, &it);
+    read_properties(d, &it);
+  } else {
+    d->supply = 0;
+  }
+  for (i = 0; i < ndevices; i++)
+    if (devices[i].pending) return;
+  /* everything is in */
+  if (publish(1) || rescan) notify(rescan);
+  rescan = 0;
+}
+
+
+static void properties_changed(DBusMessage *m) {
+  DBusMessageIter it;
+  const char  *iface;
+  Device      *d;
+
+  if (!(d = find(dbus_message_get_path(m))) || !dbus_message_has_signature(m, "sa{sv}as")) return;
+  dbus_message_iter_init(m, &it);
+  dbus_message_iter_get_basic(&it, &iface);
+  if (strcmp(iface, UPOWER_DEVICE)) return;
+  dbus_message_iter_next(&it);
+  read_properties(d, &it);
+  if (!enumerating && !d->pending && publish(ready)) notify(0);
+}
+
+
+static void owner_changed(DBusMessage *m) {
+  const char  *name, *old, *owner;
+
+  if (!dbus_message_get_args(m, NULL, DBUS_TYPE_STRING, &name, DBUS_TYPE_STRING, &old,
+                             DBUS_TYPE_STRING, &owner, DBUS_TYPE_INVALID) ||
+      strcmp(name, UPOWER)) return;
+  if (*owner) {
+    DPRINTF("D: UPower started\n")
+    enumerate();
+  } else {
+    printf("UPower went away, reading sysfs\n");
+    ndevices = 0;
+    if (publish(0)) notify(1);
+  }
+}
+
+
+static DBusHandlerResult filter(DBusConnection *c, DBusMessage *m, void *data) {
+  unsigned serial;
+  int i;
+
+  switch (dbus_message_get_type(m)) {
+  case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+  case DBUS_MESSAGE_TYPE_ERROR:
+    if ((serial = dbus_message_get_reply_serial(m)) == enumerating) {
+      devices_listed(m);
+      break;
+    }
+    for (i = 0; i < ndevices; i++)
+      if (devices[i].pending && devices[i].pending == serial) device_read(&devices[i], m);
+    break;
+  case DBUS_MESSAGE_TYPE_SIGNAL:
+    if (dbus_message_is_signal(m, PROPERTIES, "PropertiesChanged"))
+      properties_changed(m);
+    else if (dbus_message_is_signal(m, UPOWER, "DeviceAdded") ||
+             dbus_message_is_signal(m, UPOWER, "DeviceRemoved"))
+      enumerate();
+    else if (dbus_message_is_signal(m, DBUS_INTERFACE_DBUS, "NameOwnerChanged"))
+      owner_changed(m);
+    break;
+  }
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+
+static void disconnect(void) {
+  if (conn_fd >= 0) dockapp_unwatch_fd(conn_fd);
+  conn_fd = -1;
+  if (conn) {
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+  }
+  conn = NULL;
+  ndevices = 0;
+}
+
+
+/* the connection is serviced from the event loop, nothing waits on it */
+static void readable(int fd, void *data) {
+  dbus_connection_read_write(conn, 0);
+  while (dbus_connection_dispatch(conn) == DBUS_DISPATCH_DATA_REMAINS);
+  if (dbus_connection_get_is_connected(conn)) return;
+  printf("Lost the D-Bus connection, reading sysfs\n");
+  disconnect();
+  if (publish(0)) notify(1);
+}
+
+
+int upower_open(const char *bus, void (*changed)(int devices)) {
+  DBusError err;
+
+  changed_cb = changed;
+  dbus_error_init(&err);
+  if (!strcmp(bus, "system")) {
+    conn = dbus_bus_get_private(DBUS_BUS_SYSTEM, &err);
+  } else if (!strcmp(bus, "session")) {
+    conn = dbus_bus_get_private(DBUS_BUS_SESSION, &err);
+  } else if ((conn = dbus_connection_open_private(bus, &err)) && !dbus_bus_register(conn, &err)) {
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+    conn = NULL;
+  }
+  if (!conn) {
+    fprintf(stderr, "D-Bus %s: %s\n", bus, err.message);
+    dbus_error_free(&err);
+    return -1;
+  }
+  dbus_connection_set_exit_on_disconnect(conn, FALSE);
+  if (!dbus_connection_add_filter(conn, filter, NULL, NULL) ||
+      !dbus_connection_get_unix_fd(conn, &conn_fd) ||
+      !dockapp_watch_fd(conn_fd, readable, NULL)) {
+    conn_fd = -1;
+    disconnect();
+    return -1;
+  }
+  /* replies to these are not waited for */
+  dbus_bus_add_match(conn, "type='signal',sender='" UPOWER "',interface='" PROPERTIES "',"
+                     "member='PropertiesChanged'", NULL);
+  dbus_bus_add_match(conn, "type='signal',sender='" UPOWER "',interface='" UPOWER "'", NULL);
+  dbus_bus_add_match(conn, "type='signal',sender='" DBUS_SERVICE_DBUS "',"
+                     "member='NameOwnerChanged',arg0='" UPOWER "'", NULL);
+  enumerate();
+  return 0;
+}
+
+
+void upower_close(void) {
+  disconnect();
+  publish(0);
+}
+
+#else
+
+int upower_open(const char *bus, void (*changed)(int devices)) {
+  fprintf(stderr, "built without D-Bus, no UPower; reading sysfs\n");
+  return -1;
+}
+
+
+void upower_close(void) {
+}
+#endif
+
+
+int upower_get(UPowerState *state) {
+  int ok;
+
+  pthread_mutex_lock(&lock);
+  if ((ok = ready)) *state = current;
+  pthread_mutex_unlock(&lock);
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,53 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+
+#ifndef UPOWER_H
+#define UPOWER_H
+
+/*
+ * Battery and AC state from org.freedesktop.UPower instead of sysfs, for
+ * desktops where upowerd polls the hardware anyway. The devices are read
+ * once and then kept up to date from PropertiesChanged signals, with the
+ * bus connection serviced by the event loop. Until UPower has answered,
+ * and whenever it goes away, upower_get() fails and sysfs is read instead.
+ */
+typedef struct UPowerBattery {
+  int       status;         /* CHARGING, DISCHARGING or UNKNOWN */
+  long      energy;         /* uWh */
+  long      full;
+  long      design;
+  long      rate;           /* uW */
+} UPowerBattery;
+
+typedef struct UPowerState {
+  int       online;         /* on AC */
+  int       nbat;
+  UPowerBattery bat[2];
+} UPowerState;
+
+/*
+ * 'bus' is "system", "session" or a D-Bus address; -1 if it can't be
+ * reached or libdbus wasn't there at build time. 'changed' is called from the event loop when
+ * the state changed, with 'devices' set if batteries came or went or
+ * UPower itself did.
+ */
+int  upower_open(const char *bus, void (*changed)(int devices));
+void upower_close(void);
+/* a copy of the current state, -1 if there is none; from any thread */
+int  upower_get(UPowerState *state);
+
+#endif	/* ifndef UPOWER_H */
@@ -0,0 +1,62 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *    Copyright (C) 2003  Florian Krohs <krohs@uni.de>
+
+ *    Bugfixes and sysfs operation by Marcell Tarjan <tarjan.marcell@gmail.com>
+
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef WMBATTERIES_H
+#define WMBATTERIES_H
+
+#ifdef DEBUG
+# define DDOT() { printf("."); fflush(stdout); }
+# define DPRINTF(...) { printf(__VA_ARGS__); fflush(stdout); }
+#else
+# define DPRINTF(...)
+#endif
+
+#define CHARGING    3
+#define DISCHARGING 1
+#define UNKNOWN     0
+
+typedef struct AcpiInfos {
+  const char  driver_version[10];
+  int         ac_line_status;
+  int         battery_status[2];
+  int         battery_percentage[2];
+  long        rate[2];    /* averaged over the rate history */
+  long        power[2];   /* as read last, for the energy accounting */
+  long        *ratehist[2];
+  long        remain[2];
+  long        currcap[2];
+  long        design[2];
+  int         amps;       /* rates in uA and charges in uAh, not uW/uWh */
+  int         thermal_temp;
+  int         thermal_state;
+  int         hours_left;
+  int         minutes_left;
+  int         low;
+  unsigned    stale;      /* STALE_* sources showing old values */
+} AcpiInfos;
+
+/* sources that stopped answering, see sampler.h */
+#define STALE_THERMAL 0x1
+#define STALE_AC      0x2
+#define STALE_BAT0    0x4   /* STALE_BAT0 << battery number */
+
+#endif	/* ifndef WMBATTERIES_H */
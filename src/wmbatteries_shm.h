@@ -0,0 +1,127 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Layout of the shared memory segment published by wmbatteries -M, and a
+ * lock-free reader for it. The writer bumps 'seq' to an odd value, updates
+ * the sample and bumps it to the next even value; readers copy the sample
+ * and retry if 'seq' was odd or changed meanwhile. Readers never write to
+ * the segment, so they can't delay the dockapp. The segment is created
+ * with mode 0600, only processes of the same user can read it.
+ *
+ *   const WmbShm *shm = wmb_shm_open("/wmbatteries");
+ *   WmbShmSample s;
+ *   if (shm && wmb_shm_read(shm, &s) == 0) ...
+ */
+
+#ifndef WMBATTERIES_SHM_H
+#define WMBATTERIES_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* C89 compilers know no inline, GCC and clang take __inline__ there */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+# define WMB_SHM_INLINE static inline
+#else
+# define WMB_SHM_INLINE static __inline__
+#endif
+
+#define WMB_SHM_MAGIC   0x31424d57	/* "WMB1" */
+#define WMB_SHM_VERSION 1
+#define WMB_SHM_MAXBAT  2
+
+/* battery status values, same as the dockapp uses internally */
+#define WMB_SHM_UNKNOWN     0
+#define WMB_SHM_DISCHARGING 1
+#define WMB_SHM_CHARGING    3
+
+typedef struct WmbShmBattery {
+  int32_t  status;
+  int32_t  percentage;
+  int64_t  rate;          /* averaged, uW (or uA on charge based batteries) */
+  int64_t  remain;        /* uWh (or uAh) */
+  int64_t  capacity;      /* uWh (or uAh) */
+} WmbShmBattery;
+
+typedef struct WmbShmSample {
+  uint64_t generation;    /* incremented on every sample */
+  int64_t  timestamp_ns;  /* CLOCK_REALTIME of the sample */
+  int32_t  ac_online;
+  int32_t  temp;          /* tenths of a degree Celsius */
+  int32_t  low;           /* 0 ok, 1 below alarm level, 2 critical */
+  int32_t  time_left;     /* minutes to empty/full, 0 if unknown */
+  int32_t  nbat;
+  int32_t  pad;
+  WmbShmBattery bat[WMB_SHM_MAXBAT];
+} WmbShmSample;
+
+typedef struct WmbShm {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t seq;           /* odd while the writer is updating 'sample' */
+  uint32_t pad;
+  WmbShmSample sample;
+} WmbShm;
+
+
+WMB_SHM_INLINE const WmbShm *wmb_shm_open(const char *name) {
+  const WmbShm *shm;
+  struct stat st;
+  int fd;
+
+  if ((fd = shm_open(name, O_RDONLY, 0)) < 0) return NULL;
+  /* not sized yet by the writer, touching the mapping would be SIGBUS */
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(WmbShm)) {
+    close(fd);
+    return NULL;
+  }
+  shm = mmap(NULL, sizeof(WmbShm), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED) return NULL;
+  if (shm->magic != WMB_SHM_MAGIC || shm->version != WMB_SHM_VERSION) {
+    munmap((void *)shm, sizeof(WmbShm));
+    return NULL;
+  }
+  return shm;
+}
+
+
+WMB_SHM_INLINE void wmb_shm_close(const WmbShm *shm) {
+  munmap((void *)shm, sizeof(WmbShm));
+}
+
+
+/* returns 0 with a consistent copy in *out, -1 if the writer kept racing us */
+WMB_SHM_INLINE int wmb_shm_read(const WmbShm *shm, WmbShmSample *out) {
+  uint32_t s1, s2;
+  int tries;
+
+  for (tries = 0; tries < 1000; tries++) {
+    s1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+    if (s1 & 1) continue;
+    memcpy(out, (const void *)&shm->sample, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    s2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    if (s1 == s2) return 0;
+  }
+  return -1;
+}
+
+#endif	/* ifndef WMBATTERIES_SHM_H */
@@ -0,0 +1,71 @@
+# xpm2c.awk - convert an XPM image into a palette indexed DockappImage
+#
+# usage: awk -v name=parts -f xpm2c.awk parts.xpm > parts_img.h
+#
+# The palette keeps the colour spec and symbolic name of every XPM colour,
+# so dockapp_image2pixmap() can still substitute symbolic colours (the
+# Back0/Back1 back-light colours) at run time.
+
+BEGIN {
+    nrow = 0; ncol = -1
+}
+
+/^"/ {
+    line = $0
+    sub(/^"/, "", line)
+    sub(/"[^"]*$/, "", line)
+
+    if (ncol < 0) {
+	split(line, v, " ")
+	width = v[1]; height = v[2]; ncolors = v[3]; cpp = v[4]
+	ncol = 0
+	next
+    }
+
+    if (ncol < ncolors) {
+	key = substr(line, 1, cpp)
+	n = split(substr(line, cpp + 1), v, /[ \t]+/)
+	color[ncol] = ""; symbol[ncol] = ""
+	for (i = 1; i < n; i++) {
+	    if (v[i] == "c") color[ncol] = v[i + 1]
+	    if (v[i] == "s") symbol[ncol] = v[i + 1]
+	}
+	index_of[key] = ncol
+	ncol++
+	next
+    }
+
+    if (length(line) != width * cpp) {
+	printf "%s: row %d has wrong length\n", FILENAME, nrow > "/dev/stderr"
+	exit 1
+    }
+    rows[nrow++] = line
+}
+
+END {
+    if (nrow != height) {
+	printf "%s: expected %d rows, got %d\n", FILENAME, height, nrow > "/dev/stderr"
+	exit 1
+    }
+
+    printf "/* generated from %s by xpm2c.awk, do not edit */\n\n", FILENAME
+    printf "static const DockappColor %s_colors[%d] = {\n", name, ncolors
+    for (i = 0; i < ncolors; i++) {
+	printf "    { \"%s\", %s },\n", color[i], \
+	    symbol[i] == "" ? "NULL" : "\"" symbol[i] "\""
+    }
+    printf "};\n\n"
+
+    printf "static const unsigned char %s_pixels[%d] = {\n", name, width * height
+    for (r = 0; r < nrow; r++) {
+	out = "   "
+	for (c = 0; c < width; c++)
+	    out = out " " index_of[substr(rows[r], c * cpp + 1, cpp)] ","
+	print out
+    }
+    printf "};\n\n"
+
+    printf "static const DockappImage %s_img = {\n", name
+    printf "    %d, %d, %d, %s_colors, %s_pixels\n", width, height, ncolors, name, name
+    printf "};\n"
+}
@@ -0,0 +1,175 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+/*
+ * Stand-in for upowerd on a private bus: one discharging battery and an
+ * offline AC adapter, answering EnumerateDevices and GetAll until it is
+ * killed. The battery values come from the command line, in Wh and W as
+ * UPower has them:
+ *
+ *   mockupower <energy> <energy full> <energy rate>
+ *
+ * SIGUSR1 halves the energy and announces it with PropertiesChanged.
+ *
+ * Built by upowertest.sh against libdbus, which the dockapp itself does
+ * not need.
+ */
+
+#include <dbus/dbus.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#define BAT   "/org/freedesktop/UPower/devices/battery_BAT0"
+#define AC    "/org/freedesktop/UPower/devices/line_power_AC"
+
+static double energy, full, rate;
+static volatile sig_atomic_t drained;
+
+
+static void drain(int sig) {
+  drained = 1;
+}
+
+
+static void add(DBusMessageIter *a, const char *key, int type, const char *sig, const void *v) {
+  DBusMessageIter e, var;
+
+  dbus_message_iter_open_container(a, DBUS_TYPE_DICT_ENTRY, NULL, &e);
+  dbus_message_iter_append_basic(&e, DBUS_TYPE_STRING, &key);
+  dbus_message_iter_open_container(&e, DBUS_TYPE_VARIANT, sig, &var);
+  dbus_message_iter_append_basic(&var, type, v);
+  dbus_message_iter_close_container(&e, &var);
+  dbus_message_iter_close_container(a, &e);
+}
+
+
+static void add_u(DBusMessageIter *a, const char *key, dbus_uint32_t v) {
+  add(a, key, DBUS_TYPE_UINT32, "u", &v);
+}
+
+
+static void add_b(DBusMessageIter *a, const char *key, dbus_bool_t v) {
+  add(a, key, DBUS_TYPE_BOOLEAN, "b", &v);
+}
+
+
+static void add_d(DBusMessageIter *a, const char *key, double v) {
+  add(a, key, DBUS_TYPE_DOUBLE, "d", &v);
+}
+
+
+static void properties(DBusMessage *r, const char *path) {
+  DBusMessageIter it, a;
+
+  dbus_message_iter_init_append(r, &it);
+  dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "{sv}", &a);
+  add_b(&a, "PowerSupply", 1);
+  if (path && !strcmp(path, BAT)) {
+    add_u(&a, "Type", 2);
+    add_b(&a, "IsPresent", 1);
+    add_u(&a, "State", 2);
+    add_d(&a, "Energy", energy);
+    add_d(&a, "EnergyFull", full);
+    add_d(&a, "EnergyFullDesign", full);
+    add_d(&a, "EnergyRate", rate);
+  } else {
+    add_u(&a, "Type", 1);
+    add_b(&a, "Online", 0);
+  }
+  dbus_message_iter_close_container(&it, &a);
+}
+
+
+static void devices(DBusMessage *r) {
+  DBusMessageIter it, a;
+  const char *ac = AC, *bat = BAT;
+
+  dbus_message_iter_init_append(r, &it);
+  dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "o", &a);
+  dbus_message_iter_append_basic(&a, DBUS_TYPE_OBJECT_PATH, &ac);
+  dbus_message_iter_append_basic(&a, DBUS_TYPE_OBJECT_PATH, &bat);
+  dbus_message_iter_close_container(&it, &a);
+}
+
+
+static void energy_changed(DBusConnection *c) {
+  DBusMessage     *s;
+  DBusMessageIter it, a;
+  const char      *iface = "org.freedesktop.UPower.Device";
+
+  s = dbus_message_new_signal(BAT, "org.freedesktop.DBus.Properties", "PropertiesChanged");
+  dbus_message_iter_init_append(s, &it);
+  dbus_message_iter_append_basic(&it, DBUS_TYPE_STRING, &iface);
+  dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "{sv}", &a);
+  add_d(&a, "Energy", energy);
+  dbus_message_iter_close_container(&it, &a);
+  dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "s", &a);
+  dbus_message_iter_close_container(&it, &a);
+  dbus_connection_send(c, s, NULL);
+  dbus_message_unref(s);
+}
+
+
+int main(int argc, char **argv) {
+  DBusConnection  *c;
+  DBusMessage     *m, *r;
+  DBusError       err;
+
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s <energy Wh> <full Wh> <rate W>\n", argv[0]);
+    return 2;
+  }
+  energy = atof(argv[1]);
+  full = atof(argv[2]);
+  rate = atof(argv[3]);
+
+  signal(SIGUSR1, drain);
+
+  dbus_error_init(&err);
+  if (!(c = dbus_bus_get(DBUS_BUS_SESSION, &err)) ||
+      dbus_bus_request_name(c, "org.freedesktop.UPower", DBUS_NAME_FLAG_DO_NOT_QUEUE, &err) !=
+      DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+    fprintf(stderr, "mockupower: %s\n", dbus_error_is_set(&err) ? err.message : "name taken");
+    return 1;
+  }
+
+  /* a call can come in with the RequestName reply, pop before waiting */
+  do {
+    if (drained) {
+      drained = 0;
+      energy /= 2;
+      energy_changed(c);
+    }
+    while ((m = dbus_connection_pop_message(c))) {
+      r = NULL;
+      if (dbus_message_is_method_call(m, "org.freedesktop.UPower", "EnumerateDevices")) {
+        r = dbus_message_new_method_return(m);
+        devices(r);
+      } else if (dbus_message_is_method_call(m, "org.freedesktop.DBus.Properties", "GetAll")) {
+        r = dbus_message_new_method_return(m);
+        properties(r, dbus_message_get_path(m));
+      }
+      if (r) {
+        dbus_connection_send(c, r, NULL);
+        dbus_message_unref(r);
+      }
+      dbus_message_unref(m);
+    }
+  } while (dbus_connection_read_write(c, 100));
+  return 0;
+}
@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# The power policy on a copy of the fake sysfs tree in policy/: AC, 10%
+# on battery (low, taking the battery lines it has none of), 16% (still
+# low) and 17% (battery again), hot above 75 degrees and left only below
+# 73, a CPU brought online on the way, and everything written back on
+# SIGTERM.
+
+srcdir=${srcdir:-.}
+dockapp=../src/wmbatteries
+dir=$(mktemp -d) || exit 99
+dock=
+trap 'kill $dock 2>/dev/null; rm -rf "$dir"' EXIT
+
+cp -R "$srcdir/policy/sys" "$dir/sys"
+chmod -R u+w "$dir/sys"
+cpu=$dir/sys/devices/system/cpu
+ps=$dir/sys/class/power_supply
+
+cat > "$dir/rc" <<EOF
+bat0_uevent = $ps/BAT0/uevent
+bat1_uevent = $ps/BAT1/uevent
+ac_state = $ps/AC/online
+temperature = $dir/sys/class/thermal/thermal_zone0/temp
+updateinterval = 200
+capacity_interval = 200
+thermal_interval = 0
+policy_root = $dir
+policy = ac /sys/devices/system/cpu/cpu*/cpufreq/energy_performance_preference performance
+policy = battery /sys/devices/system/cpu/cpu*/cpufreq/energy_performance_preference power
+policy = battery /sys/firmware/acpi/platform_profile low-power
+policy = low /sys/devices/system/cpu/cpu*/cpufreq/energy_performance_preference power
+policy = low /sys/devices/system/cpu/cpu*/cpufreq/scaling_governor powersave
+policy = hot /sys/firmware/acpi/platform_profile quiet
+EOF
+
+# <percent> <AC online>
+battery() {
+  printf 'POWER_SUPPLY_PRESENT=1\nPOWER_SUPPLY_STATUS=%s\nPOWER_SUPPLY_POWER_NOW=10000000\nPOWER_SUPPLY_ENERGY_FULL=50000000\nPOWER_SUPPLY_ENERGY_NOW=%d\n' \
+    "$([ $2 = 1 ] && echo Charging || echo Discharging)" $(($1 * 500000)) > "$ps/BAT0/uevent"
+  echo $2 > "$ps/AC/online"
+}
+
+# <degrees>
+temp() {
+  echo $(($1 * 1000)) > "$dir/sys/class/thermal/thermal_zone0/temp"
+}
+
+# the values of a file of every CPU, once each; the writes have no newline
+cpus() {
+  for f in "$cpu"/cpu*/cpufreq/$1; do cat "$f"; echo; done | grep . | sort -u
+}
+
+# <what> <epp> <governor> <platform profile>, for every CPU
+check() {
+  sleep 1
+  got="$(cpus energy_performance_preference) $(cpus scaling_governor) \
+$(cat "$dir/sys/firmware/acpi/platform_profile")"
+  if [ "$got" != "$2 $3 $4" ]; then
+    echo "FAIL $1: '$got', wanted '$2 $3 $4'"
+    exit 1
+  fi
+  echo "ok $1: $got"
+}
+
+$dockapp -c "$dir/rc" --stream '%p %a %T' > "$dir/out" & dock=$!
+check ac performance schedutil balanced
+
+# the new CPU only gets its values with the next change of state
+cp -R "$srcdir/policy/sys/devices/system/cpu/cpu1" "$cpu/cpu2"
+chmod -R u+w "$cpu/cpu2"
+battery 10 0
+check low power powersave low-power
+battery 16 0
+check "16% still low" power powersave low-power
+battery 17 0
+check battery power schedutil low-power
+
+temp 76
+check hot power schedutil quiet
+temp 74
+check "74 degrees still hot" power schedutil quiet
+temp 72
+check "72 degrees" power schedutil low-power
+
+kill $dock; wait $dock; dock=
+check restored balance_performance schedutil balanced
+exit 0
@@ -0,0 +1,192 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+/*
+ * What one sample of the sysfs files costs, per way of reading them:
+ * fopen/fread/fclose per file as wmbatteries used to, and pread() on
+ * files kept open as sysread_batch() does. Prints the system calls per
+ * tick, counted by tracing a child with ptrace, and the wall time per
+ * tick of an untraced run. An io_uring batch came to 1 call but 60-70%
+ * more time per tick than pread() and was dropped.
+ *
+ *   readbench [file...]
+ *
+ * Without arguments it reads the power supply uevents and online files
+ * and the thermal zones, or a few CPU attributes where there are none.
+ * Not run by make check, the numbers are for reading.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "sysread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#define MAX_FILES   32
+#define BUF_SIZE    4096
+#define TICKS       20000     /* timed */
+#define TRACED      200       /* counted */
+
+enum { FOPEN, PREAD, METHODS };
+
+static const char *method_names[METHODS] = { "fopen", "pread" };
+
+static const char *files[MAX_FILES];
+static int      nfiles;
+static char     bufs[MAX_FILES][BUF_SIZE];
+static SysRead  reads[MAX_FILES];
+
+
+static void add_glob(const char *pattern) {
+  glob_t  g;
+  size_t  i;
+
+  if (glob(pattern, 0, NULL, &g) != 0) return;
+  for (i = 0; i < g.gl_pathc && nfiles < MAX_FILES; i++)
+    if (!((files[nfiles++] = strdup(g.gl_pathv[i])))) exit(1);
+  globfree(&g);
+}
+
+
+static long now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+
+/* opens what the method keeps open */
+static void prepare(int method) {
+  int i;
+
+  if (method == FOPEN) return;
+  for (i = 0; i < nfiles; i++) {
+    reads[i].fd = open(files[i], O_RDONLY | O_CLOEXEC);
+    reads[i].buf = bufs[i];
+    reads[i].size = BUF_SIZE;
+    reads[i].tag = i;
+  }
+}
+
+
+static void finish(int method) {
+  int i;
+
+  if (method != FOPEN)
+    for (i = 0; i < nfiles; i++) close(reads[i].fd);
+}
+
+
+static void run(int method, int ticks) {
+  FILE  *f;
+  int   i;
+
+  while (ticks--) {
+    if (method != FOPEN) {
+      sysread_batch(reads, nfiles);
+      continue;
+    }
+    for (i = 0; i < nfiles; i++) {
+      if (!(f = fopen(files[i], "r"))) continue;
+      bufs[i][fread(bufs[i], 1, BUF_SIZE - 1, f)] = '\0';
+      fclose(f);
+    }
+  }
+}
+
+
+/*
+ * The child stops itself around an empty stretch and around the ticks;
+ * the syscalls of the empty one are those of the stopping itself.
+ */
+static double syscalls(int method) {
+  long  count[3] = { 0, 0, 0 };
+  pid_t pid;
+  int   status, stops = 0, sig;
+
+  if ((pid = fork()) == 0) {
+    prepare(method);
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    raise(SIGSTOP);
+    raise(SIGSTOP);
+    run(method, TRACED);
+    raise(SIGSTOP);
+    _exit(0);
+  }
+  while (waitpid(pid, &status, 0) == pid && WIFSTOPPED(status)) {
+    sig = 0;
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      if (stops < 3) count[stops]++;
+    } else if (WSTOPSIG(status) == SIGSTOP) {
+      if (stops++ == 0) ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD);
+    } else {
+      sig = WSTOPSIG(status);
+    }
+    ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)sig);
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || stops < 3) return -1;
+  /* an entry and an exit stop per call */
+  return (count[2] - count[1]) / 2.0 / TRACED;
+}
+
+
+int main(int argc, char **argv) {
+  double  calls;
+  long    start;
+  int     i, m;
+
+  for (i = 1; i < argc && nfiles < MAX_FILES; i++) files[nfiles++] = argv[i];
+  if (!nfiles) {
+    add_glob("/sys/class/power_supply/*/uevent");
+    add_glob("/sys/class/power_supply/*/online");
+    add_glob("/sys/class/thermal/thermal_zone*/temp");
+  }
+  if (!nfiles) {
+    add_glob("/sys/devices/system/cpu/online");
+    add_glob("/sys/devices/system/cpu/present");
+    add_glob("/sys/devices/system/cpu/possible");
+    add_glob("/sys/devices/system/cpu/kernel_max");
+  }
+  if (!nfiles) {
+    fprintf(stderr, "no files to read\n");
+    return 1;
+  }
+  printf("%d files per tick\n", nfiles);
+
+  for (m = 0; m < METHODS; m++) {
+    prepare(m);
+    run(m, TICKS / 10);
+    start = now_us();
+    run(m, TICKS);
+    start = now_us() - start;
+    finish(m);
+    calls = syscalls(m);
+    printf("%-9s %5.1f syscalls/tick %8.2f usec/tick\n", method_names[m], calls,
+           (double)start / TICKS);
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+
+
+/*
+ * A batch of reads as the sampler does it: every file is read from the
+ * start again on each batch, cut to the buffer and NUL terminated, a bad
+ * descriptor gives -errno without stopping the others, and every read
+ * carries its own time.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "sysread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define FAST      100000      /* usec a read of a local file may take */
+#define TEXT      "POWER_SUPPLY_STATUS=Discharging\n"
+
+
+int main(void) {
+  char    name[64], bufs[4][16];
+  SysRead reads[4];
+  int     i, pass, failed = 0, fd;
+
+  snprintf(name, sizeof(name), "/tmp/wmbatteries-readtest-%d", (int)getpid());
+  if ((fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0 ||
+      write(fd, TEXT, strlen(TEXT)) != (ssize_t)strlen(TEXT)) {
+    perror(name);
+    return 1;
+  }
+  unlink(name);
+
+  memset(reads, 0, sizeof(reads));
+  reads[0].fd = open("/dev/null", O_RDONLY);
+  reads[1].fd = fd;
+  reads[2].fd = -1;
+  reads[3].fd = open("/dev/zero", O_RDONLY);
+  for (i = 0; i < 4; i++) {
+    reads[i].buf = bufs[i];
+    reads[i].size = sizeof(bufs[i]);
+    reads[i].tag = i;
+  }
+
+  /* the second batch has to see the same, not what follows the first */
+  for (pass = 0; pass < 2; pass++) {
+    memset(bufs, 'x', sizeof(bufs));
+    sysread_batch(reads, 4);
+    for (i = 0; i < 4; i++)
+      printf("pass %d read %d got %d bytes in %ld usec\n", pass, i, reads[i].len, reads[i].usec);
+    if (reads[0].len != 0 || bufs[0][0] != '\0' ||
+        reads[1].len != sizeof(bufs[1]) - 1 || strncmp(bufs[1], TEXT, sizeof(bufs[1]) - 1) ||
+        bufs[1][sizeof(bufs[1]) - 1] != '\0' ||
+        reads[2].len != -EBADF || bufs[2][0] != '\0' ||
+        reads[3].len != sizeof(bufs[3]) - 1) {
+      fprintf(stderr, "wrong lengths or contents\n");
+      failed = 1;
+    }
+    for (i = 0; i < 4; i++)
+      if (reads[i].usec < 0 || reads[i].usec > FAST) {
+        fprintf(stderr, "read %d took %ld usec\n", i, reads[i].usec);
+        failed = 1;
+      }
+  }
+  close(reads[0].fd);
+  close(fd);
+  close(reads[3].fd);
+  return failed;
+}
@@ -0,0 +1,150 @@
+/*
+ *    wmbatteries - A dockapp to monitor ACPI status of two batteries
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ */
+
+
+/*
+ * Stress test of the shared memory seqlock: the writer publishes samples
+ * in which every field is derived from the generation, while reader
+ * processes on their own mappings check that each copy they get is
+ * whole. A torn copy means a missing fence on one side. Before that, a
+ * segment not sized yet must be refused rather than mapped, and the
+ * writer's segment must be private to the user.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "shmstate.h"
+#include "wmbatteries_shm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+#define READERS   3
+#define SECONDS   2
+
+
+static int check(const WmbShmSample *s) {
+  int64_t g = s->generation;
+
+  return s->temp == (int32_t)g && s->time_left == (int32_t)(g % 1000) &&
+         s->bat[0].rate == g && s->bat[0].remain == g + 1 && s->bat[0].capacity == g + 2 &&
+         s->bat[1].rate == -g && s->bat[1].remain == 2 * g && s->bat[1].capacity == 3 * g;
+}
+
+
+static int reader(const char *name) {
+  const WmbShm  *shm;
+  WmbShmSample  s;
+  long          reads = 0, busy = 0;
+  uint64_t      last = 0;
+  time_t        end = time(NULL) + SECONDS;
+
+  if (!(shm = wmb_shm_open(name))) {
+    fprintf(stderr, "reader: can't open %s\n", name);
+    return 2;
+  }
+  while (time(NULL) < end) {
+    if (wmb_shm_read(shm, &s) < 0) {
+      busy++;
+      continue;
+    }
+    /* nothing published yet */
+    if (s.generation == 0) continue;
+    reads++;
+    if (!check(&s)) {
+      fprintf(stderr, "torn read at generation %llu\n", (unsigned long long)s.generation);
+      return 1;
+    }
+    if (s.generation < last) {
+      fprintf(stderr, "generation went back from %llu to %llu\n",
+              (unsigned long long)last, (unsigned long long)s.generation);
+      return 1;
+    }
+    last = s.generation;
+  }
+  wmb_shm_close(shm);
+  printf("reader: %ld consistent reads up to generation %llu, %ld gave up\n",
+         reads, (unsigned long long)last, busy);
+  fflush(stdout);
+  return reads ? 0 : 1;
+}
+
+
+int main(void) {
+  AcpiInfos infos;
+  struct stat st;
+  char      name[64];
+  pid_t     pids[READERS];
+  long      g;
+  int       i, status, failed = 0, running;
+
+  snprintf(name, sizeof(name), "/wmbatteries-shmtest-%d", (int)getpid());
+  /* as a reader sees it between the writer's shm_open and ftruncate */
+  if ((i = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) return 77;
+  close(i);
+  if (wmb_shm_open(name)) {
+    fprintf(stderr, "an empty segment was mapped\n");
+    shm_unlink(name);
+    return 1;
+  }
+  if (shmstate_open(name) < 0) {
+    shm_unlink(name);
+    return 77;   /* no shared memory: skipped */
+  }
+  st.st_mode = 0;
+  if ((i = shm_open(name, O_RDONLY, 0)) < 0 || fstat(i, &st) < 0 || (st.st_mode & 0777) != 0600) {
+    fprintf(stderr, "segment mode %o, wanted 600\n", (unsigned)(st.st_mode & 0777));
+    shmstate_close();
+    return 1;
+  }
+  close(i);
+  memset(&infos, 0, sizeof(infos));
+  for (i = 0; i < READERS; i++) {
+    if ((pids[i] = fork()) == 0) _exit(reader(name));
+    if (pids[i] < 0) {
+      perror("fork");
+      shmstate_close();
+      return 1;
+    }
+  }
+
+  for (g = 1, running = READERS; running; g++) {
+    /* update number g produces generation g */
+    infos.thermal_temp = (int32_t)g;
+    infos.hours_left = 0;
+    infos.minutes_left = g % 1000;
+    infos.rate[0] = g;
+    infos.remain[0] = g + 1;
+    infos.currcap[0] = g + 2;
+    infos.rate[1] = -g;
+    infos.remain[1] = 2 * g;
+    infos.currcap[1] = 3 * g;
+    shmstate_update(&infos, 2);
+    if ((g & 1023) == 0)
+      while (running && waitpid(-1, &status, WNOHANG) > 0) {
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) failed = 1;
+      }
+  }
+  shmstate_close();
+  printf("writer: %ld samples\n", g - 1);
+  return failed;
+}
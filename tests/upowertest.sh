@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+# UPower coming and going under a battery that sysfs reports in uA/uAh:
+# with UPower the rates are watts, without it amperes again, and neither
+# may leak into the other's rate history; a PropertiesChanged from UPower
+# is the very next line, and the energy log starts over in Ah when UPower
+# goes. Runs mockupower.c on a private dbus-daemon and the dockapp in
+# stream mode; skipped without libdbus or dbus-daemon.
+
+srcdir=${srcdir:-.}
+dockapp=../src/wmbatteries
+dir=$(mktemp -d) || exit 99
+bus= dock= mock=
+trap 'kill $mock $dock $bus 2>/dev/null; rm -rf "$dir"' EXIT
+
+grep -q "define HAVE_DBUS 1" ../config.h || { echo "built without libdbus"; exit 77; }
+command -v dbus-daemon >/dev/null || { echo "no dbus-daemon"; exit 77; }
+${CC:-cc} -o "$dir/mockupower" "$srcdir/mockupower.c" \
+  $(pkg-config --cflags --libs dbus-1 2>/dev/null) 2>/dev/null || { echo "no libdbus"; exit 77; }
+
+mkdir "$dir/BAT0" "$dir/AC"
+echo 0 > "$dir/AC/online"
+cat > "$dir/BAT0/uevent" <<EOF
+POWER_SUPPLY_PRESENT=1
+POWER_SUPPLY_STATUS=Discharging
+POWER_SUPPLY_CURRENT_NOW=1000000
+POWER_SUPPLY_CHARGE_FULL=4000000
+POWER_SUPPLY_CHARGE_NOW=2000000
+EOF
+cat > "$dir/rc" <<EOF
+bat0_uevent = $dir/BAT0/uevent
+bat1_uevent = $dir/BAT1/uevent
+ac_state = $dir/AC/online
+updateinterval = 200
+capacity_interval = 200
+metrics_interval = 0
+EOF
+cat > "$dir/bus.conf" <<EOF
+<!DOCTYPE busconfig PUBLIC "-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd">
+<busconfig>
+  <type>session</type>
+  <listen>unix:path=$dir/bus</listen>
+  <policy context="default">
+    <allow send_destination="*"/>
+    <allow receive_sender="*"/>
+    <allow own="*"/>
+  </policy>
+</busconfig>
+EOF
+
+dbus-daemon --config-file="$dir/bus.conf" --nofork 2>/dev/null & bus=$!
+sleep 0.5
+DBUS_SESSION_BUS_ADDRESS=unix:path=$dir/bus
+export DBUS_SESSION_BUS_ADDRESS
+
+$dockapp -c "$dir/rc" --upower session --metrics "$dir/metrics" --energy-log "$dir/energy" \
+  --stream '%p %r' > "$dir/out" & dock=$!
+
+# <what> <last status line> <rate metric>
+check() {
+  sleep 1.5
+  line=$(tail -n 1 "$dir/out")
+  if [ "$line" != "$2" ] || ! grep -q "$3{battery=\"0\"} " "$dir/metrics"; then
+    echo "FAIL $1: '$line', wanted '$2' and $3"
+    cat "$dir/metrics"
+    exit 1
+  fi
+  echo "ok $1: $line"
+}
+
+check sysfs "50 1.0" current_amperes
+"$dir/mockupower" 45 60 15.5 & mock=$!
+check upower "75 15.5" power_watts
+
+# the mock halves the energy and signals it
+seen=$(wc -l < "$dir/out")
+kill -USR1 $mock
+check "upower changed" "37 15.5" power_watts
+line=$(sed -n "$((seen + 1))p" "$dir/out")
+[ "$line" = "37 15.5" ] || { echo "FAIL: the line after the change is '$line'"; exit 1; }
+kill $mock; wait $mock 2>/dev/null; mock=
+check "sysfs again" "50 1.0" current_amperes
+
+# 1 A for about 1.5 s, nothing of the 15.5 W before
+kill $dock; wait $dock; dock=
+used=$(sed -n 's/^boot \([0-9]*\) .*/\1/p' "$dir/energy")
+if ! grep -qx "unit Ah" "$dir/energy" || [ "${used:-99999}" -gt 1000 ]; then
+  echo "FAIL energy log:"; cat "$dir/energy"
+  exit 1
+fi
+echo "ok energy log: $used uAh"
+exit 0